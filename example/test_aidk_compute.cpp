@@ -6,6 +6,8 @@
  */
 
 #include "flexiv/ai/aidk.hpp"
+#include "flexiv/ai/detection_result.hpp"
+#include "flexiv/ai/state_monitor.hpp"
 #include <ctime>
 #include <fstream>
 #include <nlohmann/json.hpp>
@@ -46,9 +48,10 @@ int main(int argc, char **argv)
     std::vector<double> tcp_force;
     load_config(js, argv[2], camera_pose, tcp_pose, tcp_force);
 
-    // AI state check
-    while (!client.is_ready()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // AI state check, the monitor is only needed until ready
+    {
+        flexiv::ai::StateMonitor monitor(argv[1], 10);
+        monitor.wait_until_ready();
     }
     flexiv::ai::AIStatus ai_status = client.get_current_state();
     std::cout << "current state code: " << ai_status.status_code << std::endl;
@@ -61,6 +64,18 @@ int main(int argc, char **argv)
     std::string arg2_str(argv[3]);
     auto total_num = std::stoi(arg2_str);
 
+    // result keys of the config, and parsed results reused by every detection
+    std::vector<flexiv::ai::ResultKey> keys;
+    for (const std::string name : js["keys"]) {
+        flexiv::ai::ResultKey key;
+        if (flexiv::ai::to_result_key(name, key)) {
+            keys.push_back(key);
+        } else {
+            std::cout << "unknown key: " << name << std::endl;
+        }
+    }
+    flexiv::ai::ParsedResults parsed;
+
     for (auto idx = 0; idx < total_num; idx++) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
         auto tic = std::chrono::system_clock::now();
@@ -88,68 +103,63 @@ int main(int argc, char **argv)
 
         std::cout << "state: " << state << std::endl;
 
+        // every key of every object in one pass
+        bool parse_state = flexiv::ai::parse_all(client, keys, parsed);
+
         std::cout << "current detected object names: ";
-        auto obj_names_size = client.get_detected_obj_names().size();
-        std::vector<std::string> obj_names = client.get_detected_obj_names();
-        for (size_t i = 0; i < obj_names_size; i++) {
-            std::cout << obj_names[i] << " ";
+        for (const auto &obj_name : parsed.obj_names) {
+            std::cout << obj_name << " ";
         }
         std::cout << " ";
 
         std::cout << "current detected object nums: ";
-        auto obj_nums_size = client.get_detected_obj_nums().size();
-        std::vector<int> obj_nums = client.get_detected_obj_nums();
-        for (size_t i = 0; i < obj_nums_size; i++) {
-            std::cout << obj_nums[i] << " ";
+        for (auto obj_num : parsed.obj_nums) {
+            std::cout << obj_num << " ";
         }
         std::cout << std::endl;
 
-        for (size_t i = 0; i < js["keys"].size(); i++) {
-            std::cout << "key: " << js["keys"][i] << std::endl;
-            std::vector<flexiv::ai::Result> result;
-            bool parse_state = client.parse_result(js["command"]["obj_name"],
-                                                   js["keys"][i], -1, result);
-
-            // parse detected timestamp
-            time_t timestamp = client.get_detected_time();
-            struct tm *timeinfo;
-            char buffer[80];
-            timeinfo = std::gmtime(&timestamp);
-            strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
-            std::cout << "detected time stamp: " << buffer << std::endl;
-
-            if (!parse_state) {
-                std::cout << "Parse result error!!!" << std::endl;
-                continue;
-            }
-            auto result_size = result.size();
-            if ((js["keys"][i] == "bbox") | (js["keys"][i] == "keypoints") |
-                (js["keys"][i] == "positions") |
-                (js["keys"][i] == "obj_pose")) {
-                for (size_t num = 0; num < result_size; num++) {
-                    for (size_t j = 0; j < result[num].vect.size(); j++) {
-                        for (size_t k = 0; k < result[num].vect[j].size();
-                             k++) {
-                            std::cout << result[num].vect[j][k] << " ";
-                        }
-                        std::cout << std::endl;
-                    }
-                }
-            } else if (js["keys"][i] == "valid") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].valid << std::endl;
-                }
-            } else if (js["keys"][i] == "double_value") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].double_value << std::endl;
-                }
-            } else if (js["keys"][i] == "int_value") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].int_value << std::endl;
+        // parse detected timestamp
+        time_t timestamp = parsed.detected_time;
+        struct tm *timeinfo;
+        char buffer[80];
+        timeinfo = std::gmtime(&timestamp);
+        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
+        std::cout << "detected time stamp: " << buffer << std::endl;
+
+        if (!parse_state) {
+            std::cout << "Parse result error!!!" << std::endl;
+        }
+        for (size_t obj = 0; obj < parsed.obj_names.size(); obj++) {
+            for (auto key : keys) {
+                std::cout << "key: " << flexiv::ai::result_key_name(key)
+                          << " of " << parsed.obj_names[obj] << std::endl;
+                const auto *result = parsed.find(obj, key);
+                if (!result) {
+                    continue;
                 }
-            } else if (js["keys"][i] == "name") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].name << std::endl;
+                for (const auto &instance : *result) {
+                    switch (key) {
+                        case flexiv::ai::KEY_VALID:
+                            std::cout << instance.valid << std::endl;
+                            break;
+                        case flexiv::ai::KEY_DOUBLE_VALUE:
+                            std::cout << instance.double_value << std::endl;
+                            break;
+                        case flexiv::ai::KEY_INT_VALUE:
+                            std::cout << instance.int_value << std::endl;
+                            break;
+                        case flexiv::ai::KEY_NAME:
+                            std::cout << instance.name << std::endl;
+                            break;
+                        default:
+                            for (const auto &values : instance.vect) {
+                                for (double value : values) {
+                                    std::cout << value << " ";
+                                }
+                                std::cout << std::endl;
+                            }
+                            break;
+                    }
                 }
             }
         }
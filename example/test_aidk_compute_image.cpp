@@ -6,10 +6,14 @@
  */
 
 #include "flexiv/ai/aidk.hpp"
+#include "flexiv/ai/detection_result.hpp"
+#include "flexiv/ai/frame_buffer_pool.hpp"
+#include "flexiv/ai/image_info.hpp"
+#include "flexiv/ai/state_monitor.hpp"
 #include <ctime>
 #include <fstream>
+#include <iterator>
 #include <nlohmann/json.hpp>
-#include <opencv2/opencv.hpp>
 #include <typeinfo>
 using json = nlohmann::json;
 
@@ -42,6 +46,13 @@ bool load_config(json &js, std::string file_path,
     return true;
 }
 
+void read_file(const std::string &file_path, std::vector<u_char> &data)
+{
+    std::ifstream file(file_path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+}
+
 int main(int argc, char **argv)
 {
     // init AIDK
@@ -56,9 +67,10 @@ int main(int argc, char **argv)
     load_config(js, argv[2], camera_pose, camera_intrinsic, tcp_pose,
                 tcp_force);
 
-    // AI state check
-    while (!client.is_ready()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // AI state check, the monitor is only needed until ready
+    {
+        flexiv::ai::StateMonitor monitor(argv[1], 10);
+        monitor.wait_until_ready();
     }
     flexiv::ai::AIStatus ai_status = client.get_current_state();
     std::cout << "current state code: " << ai_status.status_code << std::endl;
@@ -71,6 +83,21 @@ int main(int argc, char **argv)
     std::string arg2_str(argv[3]);
     auto total_num = std::stoi(arg2_str);
 
+    // encoded images reuse the buffers of previous frames
+    flexiv::ai::FrameBufferPool buffers;
+
+    // result keys of the config, and parsed results reused by every detection
+    std::vector<flexiv::ai::ResultKey> keys;
+    for (const std::string name : js["keys"]) {
+        flexiv::ai::ResultKey key;
+        if (flexiv::ai::to_result_key(name, key)) {
+            keys.push_back(key);
+        } else {
+            std::cout << "unknown key: " << name << std::endl;
+        }
+    }
+    flexiv::ai::ParsedResults parsed;
+
     for (auto idx = 0; idx < total_num; idx++) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
         auto tic = std::chrono::system_clock::now();
@@ -78,30 +105,26 @@ int main(int argc, char **argv)
         // ai >= v2.10.0
         bool state;
 
-        std::string rgb_path = js["command"]["rgb_path"];
-        cv::Mat rgb_mat = cv::imread(rgb_path);
-        std::string rgb_encoder = rgb_path.substr(rgb_path.find_last_of('.'));
-        std::vector<u_char> rgb_buf;
-        rgb_buf.resize(50 * 1024 * 1024);
-        cv::imencode(rgb_encoder, rgb_mat, rgb_buf);
-
-        std::string depth_path = js["command"]["depth_path"];
-        cv::Mat depth_mat = cv::imread(depth_path, cv::IMREAD_ANYDEPTH);
-        std::string depth_encoder =
-            depth_path.substr(depth_path.find_last_of('.'));
-        std::vector<u_char> depth_buf;
-        depth_buf.resize(50 * 1024 * 1024);
-        cv::imencode(depth_encoder, depth_mat, depth_buf);
-
-        // check rgb and depth have same size
-        if (rgb_mat.rows != depth_mat.rows || rgb_mat.cols != depth_mat.cols) {
-            throw std::runtime_error("Error: rgb and depth shape mismatch!");
+        // encoded frames, as saved by a camera driver, sent as they are
+        auto rgb_buf = buffers.acquire();
+        read_file(js["command"]["rgb_path"], *rgb_buf);
+        auto depth_buf = buffers.acquire();
+        read_file(js["command"]["depth_path"], *depth_buf);
+
+        // check format and size from the headers, before any upload
+        try {
+            flexiv::ai::validate_images(*rgb_buf, *depth_buf,
+                                        camera_intrinsic);
+        } catch (const std::invalid_argument &e) {
+            std::cout << "invalid frame: " << e.what() << std::endl;
+            continue;
         }
 
         state = client.detect_with_image(
             js["command"]["obj_name"], js["command"]["camera_id"],
             js["command"]["coordinate_id"], camera_pose, camera_intrinsic,
-            tcp_pose, tcp_force, rgb_buf, depth_buf, js["command"]["custom"]);
+            tcp_pose, tcp_force, *rgb_buf, *depth_buf,
+            js["command"]["custom"]);
 
         // print result
         auto toc = std::chrono::system_clock::now();
@@ -113,68 +136,63 @@ int main(int argc, char **argv)
 
         std::cout << "state: " << state << std::endl;
 
+        // every key of every object in one pass
+        bool parse_state = flexiv::ai::parse_all(client, keys, parsed);
+
         std::cout << "current detected object names: ";
-        auto obj_names_size = client.get_detected_obj_names().size();
-        std::vector<std::string> obj_names = client.get_detected_obj_names();
-        for (size_t i = 0; i < obj_names_size; i++) {
-            std::cout << obj_names[i] << " ";
+        for (const auto &obj_name : parsed.obj_names) {
+            std::cout << obj_name << " ";
         }
         std::cout << " ";
 
         std::cout << "current detected object nums: ";
-        auto obj_nums_size = client.get_detected_obj_nums().size();
-        std::vector<int> obj_nums = client.get_detected_obj_nums();
-        for (size_t i = 0; i < obj_nums_size; i++) {
-            std::cout << obj_nums[i] << " ";
+        for (auto obj_num : parsed.obj_nums) {
+            std::cout << obj_num << " ";
         }
         std::cout << std::endl;
 
-        for (size_t i = 0; i < js["keys"].size(); i++) {
-            std::cout << "key: " << js["keys"][i] << std::endl;
-            std::vector<flexiv::ai::Result> result;
-            bool parse_state = client.parse_result(js["command"]["obj_name"],
-                                                   js["keys"][i], -1, result);
-
-            // parse detected timestamp
-            time_t timestamp = client.get_detected_time();
-            struct tm *timeinfo;
-            char buffer[80];
-            timeinfo = std::gmtime(&timestamp);
-            strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
-            std::cout << "detected time stamp: " << buffer << std::endl;
-
-            if (!parse_state) {
-                std::cout << "Parse result error!!!" << std::endl;
-                continue;
-            }
-            auto result_size = result.size();
-            if ((js["keys"][i] == "bbox") | (js["keys"][i] == "keypoints") |
-                (js["keys"][i] == "positions") |
-                (js["keys"][i] == "obj_pose")) {
-                for (size_t num = 0; num < result_size; num++) {
-                    for (size_t j = 0; j < result[num].vect.size(); j++) {
-                        for (size_t k = 0; k < result[num].vect[j].size();
-                             k++) {
-                            std::cout << result[num].vect[j][k] << " ";
-                        }
-                        std::cout << std::endl;
-                    }
-                }
-            } else if (js["keys"][i] == "valid") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].valid << std::endl;
-                }
-            } else if (js["keys"][i] == "double_value") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].double_value << std::endl;
-                }
-            } else if (js["keys"][i] == "int_value") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].int_value << std::endl;
+        // parse detected timestamp
+        time_t timestamp = parsed.detected_time;
+        struct tm *timeinfo;
+        char buffer[80];
+        timeinfo = std::gmtime(&timestamp);
+        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
+        std::cout << "detected time stamp: " << buffer << std::endl;
+
+        if (!parse_state) {
+            std::cout << "Parse result error!!!" << std::endl;
+        }
+        for (size_t obj = 0; obj < parsed.obj_names.size(); obj++) {
+            for (auto key : keys) {
+                std::cout << "key: " << flexiv::ai::result_key_name(key)
+                          << " of " << parsed.obj_names[obj] << std::endl;
+                const auto *result = parsed.find(obj, key);
+                if (!result) {
+                    continue;
                 }
-            } else if (js["keys"][i] == "name") {
-                for (size_t num = 0; num < result_size; num++) {
-                    std::cout << result[num].name << std::endl;
+                for (const auto &instance : *result) {
+                    switch (key) {
+                        case flexiv::ai::KEY_VALID:
+                            std::cout << instance.valid << std::endl;
+                            break;
+                        case flexiv::ai::KEY_DOUBLE_VALUE:
+                            std::cout << instance.double_value << std::endl;
+                            break;
+                        case flexiv::ai::KEY_INT_VALUE:
+                            std::cout << instance.int_value << std::endl;
+                            break;
+                        case flexiv::ai::KEY_NAME:
+                            std::cout << instance.name << std::endl;
+                            break;
+                        default:
+                            for (const auto &values : instance.vect) {
+                                for (double value : values) {
+                                    std::cout << value << " ";
+                                }
+                                std::cout << std::endl;
+                            }
+                            break;
+                    }
                 }
             }
         }
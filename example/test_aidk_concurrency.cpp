@@ -0,0 +1,246 @@
+/**
+ * @example test_aidk_concurrency.cpp
+ * @brief stress test of AsyncAIDKClient, many threads detecting at once and
+ * checking the results of their own requests, while reader threads look
+ * results up
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#include "flexiv/ai/async_client.hpp"
+#include "flexiv/ai/state_monitor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+bool load_config(json &js, std::string file_path,
+                 std::vector<double> &camera_pose,
+                 std::vector<double> &tcp_pose, std::vector<double> &tcp_force)
+{
+    std::cout << "Config File: " << file_path << std::endl;
+    std::ifstream file(file_path);
+    file >> js;
+    camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0};
+    tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0};
+    tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    if (js["command"]["camera_pose"].type() != nlohmann::json::value_t::null) {
+        camera_pose = js["command"]["camera_pose"].get<std::vector<double>>();
+    }
+    if (js["command"]["tcp_pose"].type() != nlohmann::json::value_t::null) {
+        tcp_pose = js["command"]["tcp_pose"].get<std::vector<double>>();
+    }
+    if (js["command"]["tcp_force"].type() != nlohmann::json::value_t::null) {
+        tcp_force = js["command"]["tcp_force"].get<std::vector<double>>();
+    }
+    return true;
+}
+
+// Contents of a finished request, copied out of its snapshot
+struct Record
+{
+    flexiv::ai::DetectHandle handle;
+
+    uint64_t detected_time = 0;
+
+    std::vector<flexiv::ai::Pose> poses;
+};
+
+// Read the poses of all instances of an object which have one
+std::vector<flexiv::ai::Pose> read_poses(
+    const flexiv::ai::DetectionResult &result, const std::string &obj_name)
+{
+    std::vector<flexiv::ai::Pose> poses;
+    int obj = result.find_obj(obj_name);
+    if (obj < 0)
+        return poses;
+    for (auto i = 0; i < result.get_detected_obj_num(obj_name); i++) {
+        flexiv::ai::Pose pose;
+        if (result.get_pose(obj, i, pose))
+            poses.push_back(pose);
+    }
+    return poses;
+}
+
+bool same_results(const std::vector<flexiv::ai::Result> &a,
+                  const std::vector<flexiv::ai::Result> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].valid != b[i].valid || a[i].int_value != b[i].int_value
+            || a[i].double_value != b[i].double_value
+            || a[i].name != b[i].name || a[i].vect != b[i].vect)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 5) {
+        std::cout << "usage: " << argv[0]
+                  << " [address] [config_path] [total_num] [caller_num]"
+                  << std::endl;
+        return 1;
+    }
+
+    // init AIDK, two connections so that requests overlap
+    flexiv::ai::AsyncAIDKClient client(argv[1], 10, 2);
+
+    // load config file
+    json js;
+    std::vector<double> camera_pose;
+    std::vector<double> tcp_pose;
+    std::vector<double> tcp_force;
+    load_config(js, argv[2], camera_pose, tcp_pose, tcp_force);
+    std::string obj_name = js["command"]["obj_name"];
+    std::string camera_id = js["command"]["camera_id"];
+    int coordinate_id = js["command"]["coordinate_id"];
+    std::string command = js["command"]["command"];
+    std::string custom = js["command"]["custom"];
+    std::vector<std::string> keys = js["keys"];
+
+    // AI state check, the monitor is only needed until ready
+    {
+        flexiv::ai::StateMonitor monitor(argv[1], 10);
+        monitor.wait_until_ready();
+    }
+
+    auto total_num = std::stoi(argv[3]);
+    auto caller_num = std::stoi(argv[4]);
+
+    // callers: detect concurrently, and check that the results looked up by
+    // request id are those of their own request, not of another caller's
+    std::atomic<int> failed_num(0);
+    std::atomic<uint64_t> error_count(0);
+    std::mutex records_mutex;
+    std::map<uint64_t, Record> records;
+    std::vector<std::thread> callers;
+    auto tic = std::chrono::steady_clock::now();
+    for (auto c = 0; c < caller_num; c++) {
+        callers.emplace_back([&]() {
+            std::vector<flexiv::ai::Result> own, by_id;
+            for (auto idx = 0; idx < total_num; idx++) {
+                flexiv::ai::DetectHandle handle = client.detect_async(
+                    obj_name, camera_id, coordinate_id, camera_pose,
+                    tcp_pose, tcp_force, command, custom);
+                if (!handle.wait()) {
+                    failed_num++;
+                    continue;
+                }
+                flexiv::ai::DetectionResultPtr snapshot = handle.result();
+                uint64_t id = handle.id();
+                bool consistent =
+                    snapshot && client.get_result(id) == snapshot &&
+                    client.get_detected_time(id) ==
+                        snapshot->get_detected_time() &&
+                    client.get_detected_obj_names(id) ==
+                        snapshot->get_detected_obj_names() &&
+                    client.get_detected_obj_nums(id) ==
+                        snapshot->get_detected_obj_nums();
+                for (const auto &key : keys) {
+                    if (!consistent)
+                        break;
+                    bool parsed =
+                        snapshot->parse_result(obj_name, key, -1, own);
+                    consistent =
+                        client.parse_result(id, obj_name, key, -1, by_id) ==
+                            parsed &&
+                        same_results(own, by_id);
+                }
+                if (!consistent) {
+                    error_count++;
+                    continue;
+                }
+
+                // kept alive by its handle, for the readers to look it up
+                Record record;
+                record.handle = handle;
+                record.detected_time = snapshot->get_detected_time();
+                record.poses = read_poses(*snapshot, obj_name);
+                std::lock_guard<std::mutex> lock(records_mutex);
+                records.emplace(id, std::move(record));
+            }
+        });
+    }
+
+    // readers: look results up while the callers detect, by the id of a
+    // finished request, which must give back its contents, and the latest,
+    // whose poses must read the same through every accessor
+    std::atomic<bool> detecting(true);
+    std::atomic<uint64_t> read_count(0);
+    std::vector<std::thread> readers;
+    for (auto r = 0; r < std::max(1, caller_num / 2); r++) {
+        readers.emplace_back([&, r]() {
+            std::mt19937 random(r);
+            std::vector<flexiv::ai::Result> poses;
+            while (detecting) {
+                uint64_t id = 0;
+                Record expected;
+                {
+                    std::lock_guard<std::mutex> lock(records_mutex);
+                    if (!records.empty()) {
+                        auto it = records.begin();
+                        std::advance(it, random() % records.size());
+                        id = it->first;
+                        expected = it->second;
+                    }
+                }
+                if (id != 0) {
+                    auto found = client.get_result(id);
+                    if (!found
+                        || found->get_detected_time()
+                               != expected.detected_time
+                        || client.get_detected_time(id)
+                               != expected.detected_time
+                        || read_poses(*found, obj_name) != expected.poses)
+                        error_count++;
+                }
+
+                auto latest = client.get_latest_result();
+                if (latest
+                    && latest->parse_result(obj_name, "obj_pose", -1, poses)) {
+                    auto read = read_poses(*latest, obj_name);
+                    bool same = read.size() == poses.size();
+                    for (size_t i = 0; same && i < read.size(); i++) {
+                        same = !poses[i].vect.empty()
+                               && std::equal(read[i].begin(), read[i].end(),
+                                             poses[i].vect.front().begin(),
+                                             poses[i].vect.front().end());
+                    }
+                    if (!same)
+                        error_count++;
+                }
+                read_count++;
+            }
+        });
+    }
+
+    for (auto &caller : callers) {
+        caller.join();
+    }
+    auto toc = std::chrono::steady_clock::now();
+    detecting = false;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+
+    auto request_num = total_num * caller_num;
+    double duration =
+        std::chrono::duration_cast<std::chrono::milliseconds>(toc - tic)
+            .count();
+    std::cout << "detect: " << request_num << " requests by " << caller_num
+              << " threads, " << failed_num << " failed, "
+              << duration / std::max(request_num, 1) << " ms per request"
+              << std::endl;
+    std::cout << "checked: " << request_num - failed_num << " results and "
+              << read_count << " concurrent reads, " << error_count
+              << " inconsistent" << std::endl;
+
+    return error_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+/**
+ * @example test_aidk_encode.cpp
+ * @brief benchmark of image encoding options on a color and depth pair, each
+ * encoded frame checked by decoding it back
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#include "flexiv/ai/image_encoder.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+
+// Raw view of an OpenCV image
+flexiv::ai::RawImage to_raw(const cv::Mat &mat, flexiv::ai::PixelFormat format)
+{
+    flexiv::ai::RawImage raw;
+    raw.data = mat.data;
+    raw.width = mat.cols;
+    raw.height = mat.rows;
+    raw.stride = mat.step;
+    raw.format = format;
+    return raw;
+}
+
+void report(const std::string &name, double total_ms, int repeat_num,
+            size_t rgb_bytes, size_t depth_bytes)
+{
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::setw(9) << std::fixed << std::setprecision(2)
+              << total_ms / repeat_num << " ms/frame" << std::setw(10)
+              << rgb_bytes << " B rgb" << std::setw(10) << depth_bytes
+              << " B depth" << std::setw(10) << rgb_bytes + depth_bytes
+              << " B total" << std::endl;
+}
+
+// Decode an encoded frame and compare it with its source, exactly for the
+// lossless codecs, and by PSNR for JPEG
+bool check_round_trip(const std::vector<u_char> &encoded, const cv::Mat &source,
+                      bool lossy)
+{
+    cv::Mat decoded = cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+    if (decoded.empty() || decoded.size() != source.size()
+        || decoded.type() != source.type())
+        return false;
+    if (lossy)
+        return cv::PSNR(decoded, source) >= 25.0;
+    return cv::norm(decoded, source, cv::NORM_INF) == 0.0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4) {
+        std::cout << "usage: " << argv[0]
+                  << " [rgb_path] [depth_path] [repeat_num]" << std::endl;
+        return 1;
+    }
+
+    cv::Mat rgb_mat = cv::imread(argv[1]);
+    cv::Mat depth_mat = cv::imread(argv[2], cv::IMREAD_ANYDEPTH);
+    if (rgb_mat.empty() || depth_mat.type() != CV_16UC1) {
+        std::cout << "expect an 8-bit color image and a 16-bit depth image"
+                  << std::endl;
+        return 1;
+    }
+    auto repeat_num = std::max(1, std::stoi(argv[3]));
+    auto rgb = to_raw(rgb_mat, flexiv::ai::BGR8);
+    auto depth = to_raw(depth_mat, flexiv::ai::Z16);
+    std::cout << "frame: " << rgb.width << "x" << rgb.height << ", "
+              << repeat_num << " repeats" << std::endl;
+
+    // baseline: OpenCV PNG at default level, one thread, as in the examples
+    {
+        std::vector<u_char> rgb_buf, depth_buf;
+        auto tic = std::chrono::steady_clock::now();
+        for (auto i = 0; i < repeat_num; i++) {
+            cv::imencode(".png", rgb_mat, rgb_buf);
+            cv::imencode(".png", depth_mat, depth_buf);
+        }
+        auto toc = std::chrono::steady_clock::now();
+        report("cv::imencode png",
+               std::chrono::duration<double, std::milli>(toc - tic).count(),
+               repeat_num, rgb_buf.size(), depth_buf.size());
+    }
+
+    struct Option
+    {
+        std::string name;
+        flexiv::ai::EncodeOptions rgb;
+        flexiv::ai::EncodeOptions depth;
+    };
+    std::vector<Option> options(6);
+    options[0].name = "fast lossless";
+    options[1].name = "png level 1";
+    options[1].rgb.codec = options[1].depth.codec = flexiv::ai::PNG;
+    options[1].rgb.level = options[1].depth.level = 1;
+    options[2].name = "png level 6";
+    options[2].rgb.codec = options[2].depth.codec = flexiv::ai::PNG;
+    options[2].rgb.level = options[2].depth.level = 6;
+    options[3].name = "jpeg q90 + fast lossless";
+    options[3].rgb.codec = flexiv::ai::JPEG;
+    options[3].rgb.quality = 90;
+    options[4].name = "jpeg q75 + fast lossless";
+    options[4].rgb.codec = flexiv::ai::JPEG;
+    options[4].rgb.quality = 75;
+    options[5].name = "uncompressed (loopback)";
+    options[5].rgb.codec = options[5].depth.codec = flexiv::ai::UNCOMPRESSED;
+
+    std::vector<size_t> thread_nums = {1};
+    flexiv::ai::ImageEncoder all_cores;
+    if (all_cores.get_num_threads() > 1)
+        thread_nums.push_back(all_cores.get_num_threads());
+
+    // encoded frames not decoding back to their source
+    int failed_num = 0;
+    for (auto thread_num : thread_nums) {
+        flexiv::ai::ImageEncoder encoder(thread_num);
+        std::cout << std::endl << thread_num << " thread(s):" << std::endl;
+        for (const auto &option : options) {
+            std::vector<u_char> rgb_buf, depth_buf;
+            try {
+                auto tic = std::chrono::steady_clock::now();
+                for (auto i = 0; i < repeat_num; i++) {
+                    encoder.encode_pair(rgb, depth, rgb_buf, depth_buf,
+                                        option.rgb, option.depth);
+                }
+                auto toc = std::chrono::steady_clock::now();
+                report(option.name,
+                       std::chrono::duration<double, std::milli>(toc - tic)
+                           .count(),
+                       repeat_num, rgb_buf.size(), depth_buf.size());
+
+                // the last frame must decode back to the source pixels
+                bool rgb_ok = check_round_trip(
+                    rgb_buf, rgb_mat, option.rgb.codec == flexiv::ai::JPEG);
+                bool depth_ok = check_round_trip(depth_buf, depth_mat, false);
+                if (!rgb_ok || !depth_ok) {
+                    std::cout << "  round trip mismatch:"
+                              << (rgb_ok ? "" : " rgb")
+                              << (depth_ok ? "" : " depth") << std::endl;
+                    failed_num++;
+                }
+            } catch (const std::exception &e) {
+                std::cout << std::left << std::setw(28) << option.name
+                          << e.what() << std::endl;
+            }
+        }
+    }
+
+    if (failed_num > 0) {
+        std::cout << std::endl
+                  << failed_num << " option(s) failed the round trip"
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
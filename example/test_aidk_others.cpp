@@ -6,6 +6,7 @@
  */
 
 #include "flexiv/ai/aidk.hpp"
+#include "flexiv/ai/state_monitor.hpp"
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <typeinfo>
@@ -45,9 +46,10 @@ int main(int argc, char **argv)
     std::vector<double> tcp_force;
     load_config(js, argv[2], camera_pose, tcp_pose, tcp_force);
 
-    // AI state check
-    while (!client.is_ready()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // AI state check, the monitor is only needed until ready
+    {
+        flexiv::ai::StateMonitor monitor(argv[1], 10);
+        monitor.wait_until_ready();
     }
     flexiv::ai::AIStatus ai_status = client.get_current_state();
     std::cout << "current state code: " << ai_status.status_code << std::endl;
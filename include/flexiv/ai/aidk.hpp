@@ -16,6 +16,11 @@ namespace ai {
 
 class AIDKImpl;
 
+/**
+ * @brief Blocking client of AI Noema App. It is not thread-safe: calls on one
+ * instance must not overlap, and results of a detection are overwritten by the
+ * next one. See AsyncAIDKClient for concurrent use.
+ */
 class AIDKClient
 {
 public:
@@ -0,0 +1,1250 @@
+/**
+ * @file async_client.hpp
+ * @brief declaration of AsyncAIDKClient, non-blocking detect requests
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "flexiv/ai/aidk.hpp"
+#include "flexiv/ai/call_options.hpp"
+#include "flexiv/ai/detect_handle.hpp"
+#include "flexiv/ai/detection_result.hpp"
+#include "flexiv/ai/frame_buffer_pool.hpp"
+#include "flexiv/ai/image_encoder.hpp"
+#include "flexiv/ai/point_cloud.hpp"
+#include "flexiv/ai/roi.hpp"
+#include "flexiv/ai/views.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// Data structure for one detection of a batched detect request
+struct DetectEntry
+{
+    // object name
+    std::string obj_name;
+
+    // camera id to use
+    std::string camera_id;
+
+    // result coordinate space id, 0 for world space, 1 for camera space
+    int coordinate_id = 1;
+
+    // custom command
+    std::string custom;
+
+    // command name, should always be "CUSTOM"
+    std::string command = "CUSTOM";
+};
+
+// Data structure for one camera view of a multi-view detect request
+struct CameraView
+{
+    // camera id of the view
+    std::string camera_id;
+
+    // camera pose [x, y, z, qw, qx, qy, qz]
+    std::vector<double> camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0};
+
+    // camera intrinsic [width, height, ppx, ppy, fx, fy]
+    std::vector<double> camera_intrinsic = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+    // raw color image, BGR8 or RGB8
+    RawImage rgb;
+
+    // raw depth image, Z16 or Z32F, may be empty
+    RawImage depth;
+
+    // capture time, in any unit shared by the views, 0 if unknown
+    uint64_t timestamp = 0;
+};
+
+/**
+ * @brief Client issuing detect requests without blocking the caller.
+ *
+ * Requests are queued and sent by worker threads, each owning one connection
+ * (AIDKClient) to AI Noema App, so up to max_in_flight requests are
+ * outstanding at once. Each request returns a DetectHandle to poll, wait on or
+ * attach a completion callback to. Results of a request are an immutable
+ * DetectionResult, got from the handle or from this client by the request id
+ * of the handle, for as long as a copy of the handle is alive.
+ *
+ * Thread safety: every member function can be called concurrently from any
+ * thread. Result getters only take a shared lock, so reader threads run in
+ * parallel with each other and with running requests, and a DetectionResult
+ * is read without any lock. is_ready and get_current_state use a connection
+ * of their own, so they never wait for a running request. invoke is
+ * serialized with the requests on the first connection.
+ *
+ * Requests and file transfers accept CallOptions with a deadline and a
+ * CancelToken. On deadline or cancel, a queued call is dropped and a running
+ * one is abandoned at once: its handle finishes as TIMED_OUT or CANCELLED and
+ * its result is discarded, while the connection stays busy until the
+ * underlying call returns, within request_timeout.
+ *
+ * Raw images are encoded on the calling thread by an ImageEncoder over all
+ * cores, color and depth at once, and the request is then sent by a worker.
+ * So a stream of frames overlaps encoding and sending: the next frame is
+ * encoded while the previous one is on the wire. Encoded images go in buffers
+ * of a FrameBufferPool, reused once their request is done.
+ */
+class AsyncAIDKClient
+{
+public:
+    /**
+     * @brief Constructor of client.
+     *
+     * @param ip string of AI Noema App ip.
+     * @param request_timeout timeout of detect request(unit:second).
+     * @param max_in_flight number of connections, i.e. maximum number of
+     * requests outstanding at once.
+     */
+    AsyncAIDKClient(const std::string ip, float request_timeout,
+                    size_t max_in_flight = 1);
+
+    /**
+     * @brief Destructor of client, cancels queued requests and waits for the
+     * running ones.
+     */
+    ~AsyncAIDKClient();
+
+    AsyncAIDKClient(const AsyncAIDKClient &) = delete;
+    AsyncAIDKClient &operator=(const AsyncAIDKClient &) = delete;
+
+    /**
+     * @brief Non-blocking detect request, see AIDKClient::detect.
+     *
+     * @return handle of the queued request.
+     */
+    DetectHandle detect_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id = 1,
+        const std::vector<double> &camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                                  0.0},
+        const std::vector<double> &tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                               0.0},
+        const std::vector<double> &tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        const std::string command = "CUSTOM", const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request with image input, see
+     * AIDKClient::detect_with_image. Image buffers are taken by value, move
+     * them in to avoid a copy.
+     *
+     * @return handle of the queued request.
+     */
+    DetectHandle detect_with_image_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id = 1,
+        const std::vector<double> &camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                                  0.0},
+        const std::vector<double> &camera_intrinsic = {0.0, 0.0, 0.0, 0.0, 0.0,
+                                                       0.0},
+        const std::vector<double> &tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                               0.0},
+        const std::vector<double> &tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        std::vector<u_char> rgb_input = std::vector<u_char>(),
+        std::vector<u_char> depth_input = std::vector<u_char>(),
+        const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request with shared image input, e.g. to send
+     * the same images in several requests without copying them.
+     *
+     * @return handle of the queued request.
+     */
+    DetectHandle detect_with_image_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id, const std::vector<double> &camera_pose,
+        const std::vector<double> &camera_intrinsic,
+        const std::vector<double> &tcp_pose,
+        const std::vector<double> &tcp_force,
+        std::shared_ptr<const std::vector<u_char>> rgb_input,
+        std::shared_ptr<const std::vector<u_char>> depth_input,
+        const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request with raw image input, encoded by the
+     * SDK with the codec of get_encode_options, on the calling thread helped
+     * by the other cores, see ImageEncoder.
+     *
+     * @param rgb_input raw color image, BGR8 or RGB8, only read during the
+     * call.
+     * @param depth_input raw depth image, Z16 or Z32F, only read during the
+     * call, may be empty.
+     * @return handle of the queued request.
+     * @throw std::invalid_argument if an image is malformed.
+     */
+    DetectHandle detect_with_image_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id, const std::vector<double> &camera_pose,
+        const std::vector<double> &camera_intrinsic,
+        const std::vector<double> &tcp_pose,
+        const std::vector<double> &tcp_force, const RawImage &rgb_input,
+        const RawImage &depth_input = RawImage(),
+        const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request on a region of interest of raw
+     * images, see RoiFrame. Images are cropped, downscaled and encoded on the
+     * calling thread, and camera_intrinsic is adjusted to match. bbox and
+     * keypoints of the result are mapped back to the full frame.
+     *
+     * @param camera_intrinsic camera intrinsic of the full frame, required
+     * unless roi is the full frame.
+     * @param roi region of interest and downscale factor.
+     * @return handle of the queued request.
+     * @throw std::invalid_argument if an image or the region is malformed.
+     */
+    DetectHandle detect_with_image_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id, const std::vector<double> &camera_pose,
+        const std::vector<double> &camera_intrinsic,
+        const std::vector<double> &tcp_pose,
+        const std::vector<double> &tcp_force, const RawImage &rgb_input,
+        const RawImage &depth_input, const Roi &roi,
+        const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request with an organized point cloud as
+     * depth input, see CloudFrame. The depth and the camera intrinsic sent
+     * are taken from the cloud on the calling thread.
+     *
+     * @param cloud organized point cloud, only read during the call.
+     * @param rgb_input raw color image, BGR8 or RGB8, only read during the
+     * call, empty to use the color of the cloud.
+     * @return handle of the queued request.
+     * @throw std::invalid_argument if the cloud or an image is malformed, or
+     * if there is no color.
+     */
+    DetectHandle detect_with_cloud_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id, const std::vector<double> &camera_pose,
+        const std::vector<double> &tcp_pose,
+        const std::vector<double> &tcp_force, const PointCloud &cloud,
+        const RawImage &rgb_input = RawImage(), const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request with image input in caller memory,
+     * e.g. pinned camera buffers. Images are copied once, straight into the
+     * buffers sent by the request, as AIDKClient only sends from owned
+     * vectors. Poses are fixed-size arrays, so no default vector is built per
+     * call. The caller memory is free again once the call returns.
+     *
+     * @param rgb_input encoded rgb image.
+     * @param depth_input encoded depth image, may be empty.
+     * @return handle of the queued request.
+     */
+    DetectHandle detect_with_image_async(
+        std::string_view obj_name, std::string_view camera_id,
+        const int coordinate_id, const Pose &camera_pose,
+        const Intrinsic &camera_intrinsic, const Pose &tcp_pose,
+        const Wrench &tcp_force, ByteSpan rgb_input, ByteSpan depth_input,
+        std::string_view custom = std::string_view(),
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Cancel a request which has not started yet.
+     *
+     * @param request_id id of the request handle.
+     * @return true if the request was removed from the queue.
+     */
+    bool cancel(uint64_t request_id);
+
+    /**
+     * @brief Non-blocking batch of detect requests sharing the same poses.
+     * All entries are queued together, so they run on the free connections
+     * at once or back to back, with no other request in between.
+     *
+     * @param entries object name, camera id, coordinate id and custom command
+     * of each detection.
+     * @param camera_pose camera pose, can be list/ndarray, 7D or 4x4.
+     * @param tcp_pose optionally used. Robot tcp pose [x, y, z, qw, qx, qy, qz]
+     * @param tcp_force optionally used. Robot tcp force & wrench. [x, y, z, wx,
+     * wy, wx]
+     * @return handles of the queued requests, in the order of entries.
+     */
+    std::vector<DetectHandle> detect_batch_async(
+        const std::vector<DetectEntry> &entries,
+        const std::vector<double> &camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                                  0.0},
+        const std::vector<double> &tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                               0.0},
+        const std::vector<double> &tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0,
+                                                0.0},
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Blocking batch of detect requests, see detect_batch_async.
+     *
+     * @return results in the order of entries, nullptr for failed ones.
+     */
+    std::vector<DetectionResultPtr> detect_batch(
+        const std::vector<DetectEntry> &entries,
+        const std::vector<double> &camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                                  0.0},
+        const std::vector<double> &tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                               0.0},
+        const std::vector<double> &tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0,
+                                                0.0},
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request on synchronized views of several
+     * cameras, e.g. in MULTIVIEW state. The images of all views are encoded at
+     * once over all cores, then one request per view is queued, all together
+     * as in detect_batch_async, so they run on the free connections at once.
+     *
+     * @param obj_name object name.
+     * @param coordinate_id result coordinate space id, 0 for world space, 1
+     * for camera space.
+     * @param views camera id, poses, images and capture time of each view.
+     * Images are only read during the call.
+     * @param tcp_pose optionally used. Robot tcp pose [x, y, z, qw, qx, qy, qz]
+     * @param tcp_force optionally used. Robot tcp force & wrench. [x, y, z, wx,
+     * wy, wx]
+     * @param custom custom command of every view.
+     * @param max_skew maximum spread of known view timestamps, 0 to accept
+     * any.
+     * @return handles of the queued requests, in the order of views.
+     * @throw std::invalid_argument if views is empty, an image is malformed,
+     * or timestamps spread beyond max_skew.
+     */
+    std::vector<DetectHandle> detect_views_async(
+        const std::string obj_name, const int coordinate_id,
+        const std::vector<CameraView> &views,
+        const std::vector<double> &tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                               0.0},
+        const std::vector<double> &tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0,
+                                                0.0},
+        const std::string custom = "", uint64_t max_skew = 0,
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Warmup current project, if configured on NoemaEdge.
+     *
+     * @param options deadline and cancel token.
+     * @return status, false on deadline or cancel.
+     */
+    bool warmup(const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Function to send local file to remote file path.
+     *
+     * @param local_file_path string of local file path.
+     * @param remote_file_path string, must be absolute/relative path rather
+     * than single file.
+     * @param options deadline and cancel token.
+     * @return status, false on deadline or cancel.
+     */
+    bool send_file(const std::string local_file_path,
+                   const std::string remote_file_path,
+                   const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Receive remote file to local file path.
+     *
+     * @param remote_file_path file path string of remote file path.
+     * @param local_file_path string of local file path.
+     * @param options deadline and cancel token.
+     * @return status, false on deadline or cancel.
+     */
+    bool receive_file(const std::string remote_file_path,
+                      const std::string local_file_path,
+                      const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Copy local folder to remote folder.
+     *
+     * @param local_dir string of local directory.
+     * @param remote_dir string of remote directory.
+     * @param options deadline and cancel token.
+     * @return status, false on error, deadline or cancel.
+     */
+    bool send_folder(const std::string local_dir, const std::string remote_dir,
+                     const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Copy remote folder to local folder.
+     *
+     * @param remote_dir string of remote directory
+     * @param local_dir string of local directory
+     * @param options deadline and cancel token.
+     * @return status, false on deadline or cancel.
+     */
+    bool receive_folder(const std::string remote_dir,
+                        const std::string local_dir,
+                        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Get results of a finished detect request.
+     *
+     * @param request_id id of the request handle.
+     * @return shared snapshot, nullptr if no result.
+     */
+    DetectionResultPtr get_result(uint64_t request_id) const;
+
+    /**
+     * @brief Get results of the most recent successful request, i.e. the
+     * one with the greatest request id.
+     *
+     * @return shared snapshot, nullptr if no request succeeded yet.
+     */
+    DetectionResultPtr get_latest_result() const;
+
+    /**
+     * @brief Get timestamp of a finished detect request.
+     *
+     * @param request_id id of the request handle.
+     * @return timestamp in seconds, 0 if no result.
+     */
+    uint64_t get_detected_time(uint64_t request_id) const;
+
+    /**
+     * @brief Function to get all detected object names of a request.
+     *
+     * @param request_id id of the request handle.
+     * @return vector of object names.
+     */
+    std::vector<std::string> get_detected_obj_names(uint64_t request_id) const;
+
+    /**
+     * @brief Function to get all detected object nums of a request.
+     *
+     * @param request_id id of the request handle.
+     * @return vector of object nums.
+     */
+    std::vector<int> get_detected_obj_nums(uint64_t request_id) const;
+
+    /**
+     * @brief Function to get detected object number of a request based of
+     * object name.
+     *
+     * @param request_id id of the request handle.
+     * @param obj_name string of object name.
+     * @return num.
+     */
+    int get_detected_obj_num(uint64_t request_id,
+                             const std::string &obj_name) const;
+
+    /**
+     * @brief Function to parse detection result of a request.
+     *
+     * @param request_id id of the request handle.
+     * @param obj_name string of object name.
+     * @param key string of result key, one of SUPPORTED_KEYS.
+     * @param index indexed data or all data, -1 means get all data.
+     * @param result vector of struct Result
+     * @return true/false.
+     */
+    bool parse_result(uint64_t request_id, const std::string &obj_name,
+                      const std::string &key, int index,
+                      std::vector<Result> &result) const;
+
+    /**
+     * @brief Check if AI edge is ready.
+     *
+     * @return true/false.
+     */
+    bool is_ready() const
+    {
+        std::lock_guard<std::mutex> lock(status.mutex);
+        return status.client->is_ready();
+    }
+
+    /**
+     * @brief Get current AI edge state code.
+     *
+     * @return AIStatus struct.
+     */
+    AIStatus get_current_state() const
+    {
+        std::lock_guard<std::mutex> lock(status.mutex);
+        return status.client->get_current_state();
+    }
+
+    /**
+     * @brief Get codec of raw image input, chosen for the host at
+     * construction, see encode_options_for_host.
+     *
+     * @return encode options.
+     */
+    EncodeOptions get_encode_options() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return encode_options;
+    }
+
+    /**
+     * @brief Set codec of raw image input, for requests made afterwards.
+     *
+     * @param options encode options.
+     */
+    void set_encode_options(const EncodeOptions &options)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        encode_options = options;
+    }
+
+    /**
+     * @brief Run a function with exclusive use of the first connection, for
+     * calls other than detection, e.g. file transfer or config reload. Waits
+     * for the request running on that connection, if any.
+     *
+     * @param function callable taking AIDKClient &.
+     * @return return value of function.
+     */
+    template <typename Function>
+    auto invoke(Function &&function) const
+        -> decltype(function(std::declval<AIDKClient &>()))
+    {
+        auto &connection = *connections.front();
+        std::lock_guard<std::mutex> lock(connection.mutex);
+        return function(*connection.client);
+    }
+
+private:
+    struct Connection
+    {
+        std::unique_ptr<AIDKClient> client;
+
+        // held while the connection is in use
+        mutable std::mutex mutex;
+    };
+
+    struct Job
+    {
+        std::function<bool(AIDKClient &)> call;
+
+        // whether to capture detection results on success
+        bool capture = true;
+
+        // optional change of captured results, e.g. to full-frame pixels
+        std::function<DetectionResultPtr(const DetectionResultPtr &)> finish;
+
+        int coordinate_id = 0;
+
+        DetectHandle handle;
+    };
+
+    DetectHandle submit(std::function<bool(AIDKClient &)> call,
+                        int coordinate_id, const CallOptions &options,
+                        bool capture = true);
+
+    // queue jobs back to back, without other requests in between
+    std::vector<DetectHandle> submit(std::vector<Job> batch,
+                                     const CallOptions &options);
+
+    // Finish a call on deadline or cancel, dropping it if still queued
+    void abort(const DetectHandle &handle, DetectStatus status);
+
+    // Check formats of raw image input, depth may be empty
+    static void check_formats(const RawImage &rgb_input,
+                              const RawImage &depth_input);
+
+    // Get the encoder, created on the first raw image input
+    ImageEncoder &get_encoder();
+
+    // Encode raw image input with the codec of this client, depth may be
+    // empty
+    void encode_images(const RawImage &rgb_input, const RawImage &depth_input,
+                       std::vector<u_char> &rgb, std::vector<u_char> &depth);
+
+    // Remove a job from the queue, without finishing it
+    bool remove_job(uint64_t request_id, Job &removed);
+
+    // Remove the pending deadline of a call, if not fired yet
+    void remove_deadline(CallOptions::Clock::time_point deadline,
+                         const std::shared_ptr<detail::DetectState> &state);
+
+    void run(size_t lane);
+
+    void run_deadlines();
+
+    struct Request
+    {
+        // expired once every copy of the handle is gone
+        std::weak_ptr<detail::DetectState> state;
+
+        DetectionResultPtr result;
+    };
+
+    std::vector<std::unique_ptr<Connection>> connections;
+
+    // connection of state queries, apart from the requests
+    Connection status;
+
+    // guards jobs, next_id, stopping and encode_options
+    mutable std::mutex mutex;
+
+    std::condition_variable cv;
+
+    std::deque<Job> jobs;
+
+    uint64_t next_id = 1;
+
+    // guards requests and latest, shared by result readers
+    mutable std::shared_mutex results_mutex;
+
+    std::unordered_map<uint64_t, Request> requests;
+
+    // size of requests triggering the next drop of expired ids
+    size_t sweep_size = 64;
+
+    std::pair<uint64_t, DetectionResultPtr> latest;
+
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+
+    // pending deadlines of calls, guarded by mutex
+    std::multimap<CallOptions::Clock::time_point,
+                  std::weak_ptr<detail::DetectState>>
+        deadlines;
+
+    std::condition_variable deadline_cv;
+
+    std::thread deadline_thread;
+
+    EncodeOptions encode_options;
+
+    std::once_flag encoder_flag;
+
+    std::unique_ptr<ImageEncoder> encoder;
+
+    // encoded images of queued and running requests, reused once sent
+    FrameBufferPool buffers;
+};
+
+inline AsyncAIDKClient::AsyncAIDKClient(const std::string ip,
+                                        float request_timeout,
+                                        size_t max_in_flight)
+: encode_options(encode_options_for_host(ip))
+, buffers(0, 4 * std::max<size_t>(1, max_in_flight))
+{
+    if (max_in_flight == 0)
+        max_in_flight = 1;
+    for (size_t i = 0; i < max_in_flight; i++) {
+        connections.emplace_back(new Connection());
+        connections.back()->client.reset(new AIDKClient(ip, request_timeout));
+    }
+    status.client.reset(new AIDKClient(ip, request_timeout));
+    for (size_t i = 0; i < max_in_flight; i++) {
+        workers.emplace_back(&AsyncAIDKClient::run, this, i);
+    }
+    deadline_thread = std::thread(&AsyncAIDKClient::run_deadlines, this);
+}
+
+inline AsyncAIDKClient::~AsyncAIDKClient()
+{
+    std::deque<Job> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        cancelled.swap(jobs);
+        deadlines.clear();
+    }
+    cv.notify_all();
+    deadline_cv.notify_all();
+    for (auto &job : cancelled) {
+        job.handle.complete(CANCELLED);
+    }
+    for (auto &worker : workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+    if (deadline_thread.joinable())
+        deadline_thread.join();
+}
+
+inline DetectHandle AsyncAIDKClient::detect_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    const std::string command, const std::string custom,
+    const CallOptions &options)
+{
+    return submit([=](AIDKClient &client) {
+        return client.detect(obj_name, camera_id, coordinate_id, camera_pose,
+                             tcp_pose, tcp_force, command, custom);
+    }, coordinate_id, options);
+}
+
+inline DetectHandle AsyncAIDKClient::detect_with_image_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &camera_intrinsic,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    std::vector<u_char> rgb_input, std::vector<u_char> depth_input,
+    const std::string custom, const CallOptions &options)
+{
+    // std::function requires a copyable callable, share the image buffers
+    return detect_with_image_async(
+        obj_name, camera_id, coordinate_id, camera_pose, camera_intrinsic,
+        tcp_pose, tcp_force,
+        std::make_shared<const std::vector<u_char>>(std::move(rgb_input)),
+        std::make_shared<const std::vector<u_char>>(std::move(depth_input)),
+        custom, options);
+}
+
+inline DetectHandle AsyncAIDKClient::detect_with_image_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &camera_intrinsic,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    const RawImage &rgb_input, const RawImage &depth_input,
+    const std::string custom, const CallOptions &options)
+{
+    auto rgb = buffers.acquire();
+    auto depth = buffers.acquire();
+    encode_images(rgb_input, depth_input, *rgb, *depth);
+    return detect_with_image_async(obj_name, camera_id, coordinate_id,
+                                   camera_pose, camera_intrinsic, tcp_pose,
+                                   tcp_force, std::move(rgb), std::move(depth),
+                                   custom, options);
+}
+
+inline DetectHandle AsyncAIDKClient::detect_with_image_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &camera_intrinsic,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    const RawImage &rgb_input, const RawImage &depth_input, const Roi &roi,
+    const std::string custom, const CallOptions &options)
+{
+    if (roi.is_full_frame())
+        return detect_with_image_async(obj_name, camera_id, coordinate_id,
+                                       camera_pose, camera_intrinsic, tcp_pose,
+                                       tcp_force, rgb_input, depth_input,
+                                       custom, options);
+
+    RoiFrame frame(roi, rgb_input, depth_input, camera_intrinsic);
+    auto rgb = buffers.acquire();
+    auto depth = buffers.acquire();
+    encode_images(frame.get_rgb(), frame.get_depth(), *rgb, *depth);
+
+    std::vector<Job> batch(1);
+    auto intrinsic = frame.get_camera_intrinsic();
+    batch.front().call = [=](AIDKClient &client) {
+        return client.detect_with_image(obj_name, camera_id, coordinate_id,
+                                        camera_pose, intrinsic, tcp_pose,
+                                        tcp_force, *rgb, *depth, custom);
+    };
+    batch.front().coordinate_id = coordinate_id;
+    auto mapping = frame.get_mapping();
+    batch.front().finish = [mapping](const DetectionResultPtr &result) {
+        return result->map_image_points(mapping);
+    };
+    return submit(std::move(batch), options).front();
+}
+
+inline DetectHandle AsyncAIDKClient::detect_with_cloud_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    const PointCloud &cloud, const RawImage &rgb_input,
+    const std::string custom, const CallOptions &options)
+{
+    CloudFrame frame(cloud);
+    const RawImage &rgb = rgb_input.data ? rgb_input : frame.get_rgb();
+    if (!rgb.data)
+        throw std::invalid_argument("detect_with_cloud_async: no color");
+    return detect_with_image_async(obj_name, camera_id, coordinate_id,
+                                   camera_pose, frame.get_camera_intrinsic(),
+                                   tcp_pose, tcp_force, rgb, frame.get_depth(),
+                                   custom, options);
+}
+
+inline DetectHandle AsyncAIDKClient::detect_with_image_async(
+    std::string_view obj_name, std::string_view camera_id,
+    const int coordinate_id, const Pose &camera_pose,
+    const Intrinsic &camera_intrinsic, const Pose &tcp_pose,
+    const Wrench &tcp_force, ByteSpan rgb_input, ByteSpan depth_input,
+    std::string_view custom, const CallOptions &options)
+{
+    auto rgb = buffers.acquire();
+    rgb->assign(rgb_input.begin(), rgb_input.end());
+    auto depth = buffers.acquire();
+    depth->assign(depth_input.begin(), depth_input.end());
+    return detect_with_image_async(
+        std::string(obj_name), std::string(camera_id), coordinate_id,
+        std::vector<double>(camera_pose.begin(), camera_pose.end()),
+        std::vector<double>(camera_intrinsic.begin(), camera_intrinsic.end()),
+        std::vector<double>(tcp_pose.begin(), tcp_pose.end()),
+        std::vector<double>(tcp_force.begin(), tcp_force.end()),
+        std::move(rgb), std::move(depth), std::string(custom), options);
+}
+
+inline DetectHandle AsyncAIDKClient::detect_with_image_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &camera_intrinsic,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    std::shared_ptr<const std::vector<u_char>> rgb_input,
+    std::shared_ptr<const std::vector<u_char>> depth_input,
+    const std::string custom, const CallOptions &options)
+{
+    return submit([=](AIDKClient &client) {
+        return client.detect_with_image(obj_name, camera_id, coordinate_id,
+                                        camera_pose, camera_intrinsic, tcp_pose,
+                                        tcp_force, *rgb_input, *depth_input,
+                                        custom);
+    }, coordinate_id, options);
+}
+
+inline bool AsyncAIDKClient::cancel(uint64_t request_id)
+{
+    Job cancelled;
+    if (!remove_job(request_id, cancelled))
+        return false;
+    cancelled.handle.complete(CANCELLED);
+    return true;
+}
+
+inline bool AsyncAIDKClient::remove_job(uint64_t request_id, Job &removed)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(jobs.begin(), jobs.end(), [&](const Job &job) {
+        return job.handle.id() == request_id;
+    });
+    if (it == jobs.end())
+        return false;
+    removed = std::move(*it);
+    jobs.erase(it);
+    return true;
+}
+
+inline void AsyncAIDKClient::remove_deadline(
+    CallOptions::Clock::time_point deadline,
+    const std::shared_ptr<detail::DetectState> &state)
+{
+    // looked up by owner, as the deadline thread may have erased the entry
+    std::lock_guard<std::mutex> lock(mutex);
+    auto range = deadlines.equal_range(deadline);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (!it->second.owner_before(state)
+            && !state.owner_before(it->second)) {
+            deadlines.erase(it);
+            return;
+        }
+    }
+}
+
+inline void AsyncAIDKClient::abort(const DetectHandle &handle,
+                                   DetectStatus status)
+{
+    // finish first, so that a job starting meanwhile is skipped
+    handle.complete(status);
+    Job removed;
+    remove_job(handle.id(), removed);
+}
+
+inline std::vector<DetectHandle> AsyncAIDKClient::detect_batch_async(
+    const std::vector<DetectEntry> &entries,
+    const std::vector<double> &camera_pose, const std::vector<double> &tcp_pose,
+    const std::vector<double> &tcp_force, const CallOptions &options)
+{
+    std::vector<Job> batch;
+    for (const auto &entry : entries) {
+        Job job;
+        job.call = [=](AIDKClient &client) {
+            return client.detect(entry.obj_name, entry.camera_id,
+                                 entry.coordinate_id, camera_pose, tcp_pose,
+                                 tcp_force, entry.command, entry.custom);
+        };
+        job.coordinate_id = entry.coordinate_id;
+        batch.push_back(std::move(job));
+    }
+    return submit(std::move(batch), options);
+}
+
+inline std::vector<DetectHandle> AsyncAIDKClient::detect_views_async(
+    const std::string obj_name, const int coordinate_id,
+    const std::vector<CameraView> &views, const std::vector<double> &tcp_pose,
+    const std::vector<double> &tcp_force, const std::string custom,
+    uint64_t max_skew, const CallOptions &options)
+{
+    if (views.empty())
+        throw std::invalid_argument("detect_views_async: no view");
+
+    // unknown timestamps are not checked
+    uint64_t first = UINT64_MAX, last = 0;
+    for (const auto &view : views) {
+        check_formats(view.rgb, view.depth);
+        if (view.timestamp != 0) {
+            first = std::min(first, view.timestamp);
+            last = std::max(last, view.timestamp);
+        }
+    }
+    if (max_skew != 0 && last > first && last - first > max_skew)
+        throw std::invalid_argument(
+            "detect_views_async: views are not synchronized");
+
+    auto codec = get_encode_options();
+    std::vector<FrameBuffer> rgbs, depths;
+    std::vector<EncodeTask> tasks;
+    for (const auto &view : views) {
+        rgbs.push_back(buffers.acquire());
+        depths.push_back(buffers.acquire());
+        EncodeTask task;
+        task.image = &view.rgb;
+        task.encoded = rgbs.back().get();
+        task.options = codec;
+        tasks.push_back(task);
+        if (view.depth.data) {
+            task.image = &view.depth;
+            task.encoded = depths.back().get();
+            task.options = detail::depth_options(codec);
+            tasks.push_back(task);
+        }
+    }
+    get_encoder().encode_all(tasks);
+
+    std::vector<Job> batch;
+    for (size_t i = 0; i < views.size(); i++) {
+        Job job;
+        std::shared_ptr<const std::vector<u_char>> rgb = rgbs[i],
+                                                   depth = depths[i];
+        const std::string camera_id = views[i].camera_id;
+        const std::vector<double> camera_pose = views[i].camera_pose;
+        const std::vector<double> camera_intrinsic = views[i].camera_intrinsic;
+        job.call = [=](AIDKClient &client) {
+            return client.detect_with_image(obj_name, camera_id, coordinate_id,
+                                            camera_pose, camera_intrinsic,
+                                            tcp_pose, tcp_force, *rgb, *depth,
+                                            custom);
+        };
+        job.coordinate_id = coordinate_id;
+        batch.push_back(std::move(job));
+    }
+    return submit(std::move(batch), options);
+}
+
+inline std::vector<DetectionResultPtr> AsyncAIDKClient::detect_batch(
+    const std::vector<DetectEntry> &entries,
+    const std::vector<double> &camera_pose, const std::vector<double> &tcp_pose,
+    const std::vector<double> &tcp_force, const CallOptions &options)
+{
+    std::vector<DetectionResultPtr> results;
+    for (const auto &handle : detect_batch_async(entries, camera_pose, tcp_pose,
+                                                 tcp_force, options)) {
+        handle.wait();
+        results.push_back(handle.result());
+    }
+    return results;
+}
+
+inline bool AsyncAIDKClient::warmup(const CallOptions &options)
+{
+    return submit([](AIDKClient &client) { return client.warmup(); }, 0,
+                  options, false)
+        .wait();
+}
+
+inline bool AsyncAIDKClient::send_file(const std::string local_file_path,
+                                       const std::string remote_file_path,
+                                       const CallOptions &options)
+{
+    return submit([=](AIDKClient &client) {
+        return client.send_file(local_file_path, remote_file_path);
+    }, 0, options, false)
+        .wait();
+}
+
+inline bool AsyncAIDKClient::receive_file(const std::string remote_file_path,
+                                          const std::string local_file_path,
+                                          const CallOptions &options)
+{
+    return submit([=](AIDKClient &client) {
+        return client.receive_file(remote_file_path, local_file_path);
+    }, 0, options, false)
+        .wait();
+}
+
+inline bool AsyncAIDKClient::send_folder(const std::string local_dir,
+                                         const std::string remote_dir,
+                                         const CallOptions &options)
+{
+    return submit([=](AIDKClient &client) {
+        client.send_folder(local_dir, remote_dir);
+        return true;
+    }, 0, options, false)
+        .wait();
+}
+
+inline bool AsyncAIDKClient::receive_folder(const std::string remote_dir,
+                                            const std::string local_dir,
+                                            const CallOptions &options)
+{
+    return submit([=](AIDKClient &client) {
+        client.receive_folder(remote_dir, local_dir);
+        return true;
+    }, 0, options, false)
+        .wait();
+}
+
+inline DetectionResultPtr
+AsyncAIDKClient::get_result(uint64_t request_id) const
+{
+    std::shared_lock<std::shared_mutex> lock(results_mutex);
+    auto it = requests.find(request_id);
+    if (it == requests.end() || it->second.state.expired())
+        return nullptr;
+    return it->second.result;
+}
+
+inline DetectionResultPtr AsyncAIDKClient::get_latest_result() const
+{
+    std::shared_lock<std::shared_mutex> lock(results_mutex);
+    return latest.second;
+}
+
+inline uint64_t AsyncAIDKClient::get_detected_time(uint64_t request_id) const
+{
+    auto result = get_result(request_id);
+    return result ? result->get_detected_time() : 0;
+}
+
+inline std::vector<std::string>
+AsyncAIDKClient::get_detected_obj_names(uint64_t request_id) const
+{
+    auto result = get_result(request_id);
+    return result ? result->get_detected_obj_names()
+                  : std::vector<std::string>();
+}
+
+inline std::vector<int>
+AsyncAIDKClient::get_detected_obj_nums(uint64_t request_id) const
+{
+    auto result = get_result(request_id);
+    return result ? result->get_detected_obj_nums() : std::vector<int>();
+}
+
+inline int
+AsyncAIDKClient::get_detected_obj_num(uint64_t request_id,
+                                      const std::string &obj_name) const
+{
+    auto result = get_result(request_id);
+    return result ? result->get_detected_obj_num(obj_name) : 0;
+}
+
+inline bool AsyncAIDKClient::parse_result(uint64_t request_id,
+                                          const std::string &obj_name,
+                                          const std::string &key, int index,
+                                          std::vector<Result> &result) const
+{
+    auto snapshot = get_result(request_id);
+    if (!snapshot) {
+        result.clear();
+        return false;
+    }
+    return snapshot->parse_result(obj_name, key, index, result);
+}
+
+inline void AsyncAIDKClient::encode_images(const RawImage &rgb_input,
+                                           const RawImage &depth_input,
+                                           std::vector<u_char> &rgb,
+                                           std::vector<u_char> &depth)
+{
+    check_formats(rgb_input, depth_input);
+    auto codec = get_encode_options();
+    if (depth_input.data)
+        get_encoder().encode_pair(rgb_input, depth_input, rgb, depth, codec,
+                                  detail::depth_options(codec));
+    else
+        get_encoder().encode(rgb_input, rgb, codec);
+}
+
+inline void AsyncAIDKClient::check_formats(const RawImage &rgb_input,
+                                           const RawImage &depth_input)
+{
+    if (rgb_input.format != BGR8 && rgb_input.format != RGB8)
+        throw std::invalid_argument("rgb_input must be BGR8 or RGB8");
+    if (depth_input.data && depth_input.format != Z16
+        && depth_input.format != Z32F)
+        throw std::invalid_argument("depth_input must be Z16 or Z32F");
+}
+
+inline ImageEncoder &AsyncAIDKClient::get_encoder()
+{
+    std::call_once(encoder_flag,
+                   [this]() { encoder.reset(new ImageEncoder()); });
+    return *encoder;
+}
+
+inline DetectHandle
+AsyncAIDKClient::submit(std::function<bool(AIDKClient &)> call,
+                        int coordinate_id, const CallOptions &options,
+                        bool capture)
+{
+    std::vector<Job> batch(1);
+    batch.front().call = std::move(call);
+    batch.front().capture = capture;
+    batch.front().coordinate_id = coordinate_id;
+    return submit(std::move(batch), options).front();
+}
+
+inline std::vector<DetectHandle>
+AsyncAIDKClient::submit(std::vector<Job> batch, const CallOptions &options)
+{
+    std::vector<DetectHandle> handles;
+    for (auto &job : batch) {
+        job.handle = DetectHandle(std::make_shared<detail::DetectState>());
+        handles.push_back(job.handle);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            for (auto &handle : handles) {
+                handle.complete(CANCELLED);
+            }
+            return handles;
+        }
+        std::unique_lock<std::shared_mutex> results_lock(results_mutex);
+
+        // drop ids of released handles, amortized over submissions
+        if (requests.size() >= sweep_size) {
+            for (auto it = requests.begin(); it != requests.end();) {
+                it = it->second.state.expired() ? requests.erase(it)
+                                                : std::next(it);
+            }
+            sweep_size = std::max<size_t>(64, 2 * requests.size());
+        }
+        for (auto &job : batch) {
+            job.handle.shared->id = next_id++;
+            requests[job.handle.shared->id].state = job.handle.shared;
+            if (options.deadline != CallOptions::Clock::time_point::max())
+                deadlines.emplace(options.deadline, job.handle.shared);
+            jobs.push_back(std::move(job));
+        }
+    }
+    cv.notify_all();
+    if (options.deadline != CallOptions::Clock::time_point::max()) {
+        deadline_cv.notify_one();
+
+        // dropped once finished, so long deadlines do not pile up
+        auto deadline = options.deadline;
+        for (auto &handle : handles) {
+            handle.then([this, deadline](const DetectHandle &finished) {
+                remove_deadline(deadline, finished.shared);
+            });
+        }
+    }
+
+    // unregistered once finished, so long-lived tokens do not pile up
+    for (auto &handle : handles) {
+        std::weak_ptr<detail::DetectState> weak = handle.shared;
+        uint64_t registration = options.token.on_cancel([this, weak]() {
+            if (auto state = weak.lock())
+                abort(DetectHandle(state), CANCELLED);
+        });
+        if (registration != 0) {
+            CancelToken token = options.token;
+            handle.then([token, registration](const DetectHandle &) {
+                token.remove_on_cancel(registration);
+            });
+        }
+    }
+    return handles;
+}
+
+inline void AsyncAIDKClient::run(size_t lane)
+{
+    auto &connection = *connections[lane];
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        // already finished on deadline or cancel
+        if (job.handle.ready())
+            continue;
+
+        bool success = false;
+        DetectionResultPtr result;
+        try {
+            std::lock_guard<std::mutex> lock(connection.mutex);
+            success = job.call(*connection.client);
+            if (success && job.capture)
+                result = DetectionResult::capture(*connection.client,
+                                                  job.coordinate_id);
+            if (result && job.finish)
+                result = job.finish(result);
+        } catch (...) {
+            success = false;
+        }
+
+        // abandoned on deadline or cancel while running
+        if (job.handle.ready())
+            continue;
+
+        if (result) {
+            std::unique_lock<std::shared_mutex> lock(results_mutex);
+            auto it = requests.find(job.handle.id());
+            if (it != requests.end())
+                it->second.result = result;
+            if (job.handle.id() > latest.first)
+                latest = {job.handle.id(), result};
+        }
+
+        job.handle.complete(success ? SUCCEEDED : FAILED, std::move(result));
+    }
+}
+
+inline void AsyncAIDKClient::run_deadlines()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        if (deadlines.empty()) {
+            deadline_cv.wait(lock);
+        } else {
+            // copied, the deadline may be erased while waiting
+            auto deadline = deadlines.begin()->first;
+            deadline_cv.wait_until(lock, deadline);
+        }
+
+        std::vector<std::shared_ptr<detail::DetectState>> due;
+        auto now = CallOptions::Clock::now();
+        while (!deadlines.empty() && deadlines.begin()->first <= now) {
+            if (auto state = deadlines.begin()->second.lock())
+                due.push_back(std::move(state));
+            deadlines.erase(deadlines.begin());
+        }
+        lock.unlock();
+        for (auto &state : due) {
+            abort(DetectHandle(state), TIMED_OUT);
+        }
+        lock.lock();
+    }
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
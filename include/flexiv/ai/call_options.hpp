@@ -0,0 +1,136 @@
+/**
+ * @file call_options.hpp
+ * @brief declaration of per-call deadline and cancellation options
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace flexiv {
+namespace ai {
+
+/**
+ * @brief Token to cancel calls. Copies share the same state, so a token given
+ * to several calls cancels all of them at once, e.g. on e-stop.
+ */
+class CancelToken
+{
+public:
+    CancelToken()
+    : shared(std::make_shared<State>())
+    {}
+
+    /**
+     * @brief Cancel every call using this token, now and in the future.
+     */
+    void cancel() const
+    {
+        std::unordered_map<uint64_t, std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->cancelled)
+                return;
+            shared->cancelled = true;
+            callbacks.swap(shared->callbacks);
+        }
+        for (auto &pair : callbacks) {
+            pair.second();
+        }
+    }
+
+    /**
+     * @brief Check if the token is cancelled.
+     *
+     * @return true/false.
+     */
+    bool is_cancelled() const
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->cancelled;
+    }
+
+    /**
+     * @brief Register a function called on cancel, immediately if already
+     * cancelled.
+     *
+     * @param callback function to call.
+     * @return registration id, 0 if called immediately.
+     */
+    uint64_t on_cancel(std::function<void()> callback) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (!shared->cancelled) {
+                uint64_t id = shared->next_id++;
+                shared->callbacks.emplace(id, std::move(callback));
+                return id;
+            }
+        }
+        callback();
+        return 0;
+    }
+
+    /**
+     * @brief Unregister a function registered by on_cancel.
+     *
+     * @param id registration id.
+     */
+    void remove_on_cancel(uint64_t id) const
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->callbacks.erase(id);
+    }
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+
+        bool cancelled = false;
+
+        uint64_t next_id = 1;
+
+        std::unordered_map<uint64_t, std::function<void()>> callbacks;
+    };
+
+    std::shared_ptr<State> shared;
+};
+
+// Options of a single call
+struct CallOptions
+{
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Options with a deadline relative to now.
+     *
+     * @param timeout time allowed for the call.
+     * @return options.
+     */
+    template <typename Rep, typename Period>
+    static CallOptions within(const std::chrono::duration<Rep, Period> &timeout)
+    {
+        CallOptions options;
+        options.deadline =
+            Clock::now() +
+            std::chrono::duration_cast<Clock::duration>(timeout);
+        return options;
+    }
+
+    // absolute deadline of the call, none by default
+    Clock::time_point deadline = Clock::time_point::max();
+
+    // token to cancel the call
+    CancelToken token;
+};
+
+} /* namespace ai */
+} /* namespace flexiv */
@@ -0,0 +1,618 @@
+/**
+ * @file client_pool.hpp
+ * @brief declaration of AIDKClientPool, detect requests balanced over several
+ * AI Noema App hosts
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+#include "flexiv/ai/async_client.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// Options of hedged detect requests
+struct HedgeOptions
+{
+    // send a duplicate request once the first one is slower than this
+    // percentile of recent latencies, in range (0, 1]
+    double percentile = 0.95;
+
+    // number of recent latencies needed before hedging starts
+    size_t min_samples = 20;
+
+    // number of recent latencies kept
+    size_t window = 256;
+
+    // allow the duplicate on the endpoint of the first request, only useful if
+    // it has several connections
+    bool allow_same_endpoint = false;
+};
+
+// Counters of hedged detect requests
+struct HedgeStats
+{
+    // requests sent with a hedging deadline
+    uint64_t requests = 0;
+
+    // duplicate requests sent
+    uint64_t hedged = 0;
+
+    // duplicate requests finishing first
+    uint64_t hedge_won = 0;
+
+    // losing requests removed from the queue before running, the others run
+    // to completion and their results are discarded
+    uint64_t cancelled = 0;
+};
+
+/**
+ * @brief Client spreading detect requests over several AI Noema App hosts
+ * running the same project.
+ *
+ * Each request goes to the healthy endpoint with the least outstanding
+ * requests. A monitor thread per endpoint reads its state periodically over
+ * a connection of its own, so health checks neither wait for detect requests
+ * nor for other endpoints, and takes an endpoint out of rotation while its
+ * state cannot be read or is UNKNOWN or ERROR. If no endpoint is healthy, all
+ * of them are used. Every member function can be called concurrently from
+ * any thread.
+ *
+ * With hedging enabled, a request not finished within a percentile of recent
+ * latencies is duplicated on another endpoint, the first successful answer is
+ * taken and the loser is cancelled or its result discarded.
+ *
+ * Request ids are those of the endpoint the request was sent to, of the
+ * first attempt for a hedged request, and are only unique per endpoint. Two
+ * handles of the pool may have the same id, so ids are not keys across the
+ * pool: results are read from the handles.
+ */
+class AIDKClientPool
+{
+public:
+    /**
+     * @brief Constructor of pool.
+     *
+     * @param ips strings of AI Noema App ips.
+     * @param request_timeout timeout of detect request(unit:second).
+     * @param max_in_flight number of connections per endpoint.
+     * @param health_interval period of endpoint state check.
+     */
+    AIDKClientPool(const std::vector<std::string> &ips, float request_timeout,
+                   size_t max_in_flight = 1,
+                   std::chrono::milliseconds health_interval =
+                       std::chrono::milliseconds(1000));
+
+    /**
+     * @brief Destructor of pool, cancels queued requests and waits for the
+     * running ones.
+     */
+    ~AIDKClientPool();
+
+    AIDKClientPool(const AIDKClientPool &) = delete;
+    AIDKClientPool &operator=(const AIDKClientPool &) = delete;
+
+    /**
+     * @brief Non-blocking detect request, see AIDKClient::detect.
+     *
+     * @return handle of the queued request, results are got from the handle,
+     * whose id is only unique per endpoint.
+     */
+    DetectHandle detect_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id = 1,
+        const std::vector<double> &camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                                  0.0},
+        const std::vector<double> &tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                               0.0},
+        const std::vector<double> &tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        const std::string command = "CUSTOM", const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Non-blocking detect request with image input, see
+     * AIDKClient::detect_with_image.
+     *
+     * @return handle of the queued request, results are got from the handle,
+     * whose id is only unique per endpoint.
+     */
+    DetectHandle detect_with_image_async(
+        const std::string obj_name, const std::string camera_id,
+        const int coordinate_id = 1,
+        const std::vector<double> &camera_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                                  0.0},
+        const std::vector<double> &camera_intrinsic = {0.0, 0.0, 0.0, 0.0, 0.0,
+                                                       0.0},
+        const std::vector<double> &tcp_pose = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                               0.0},
+        const std::vector<double> &tcp_force = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        std::vector<u_char> rgb_input = std::vector<u_char>(),
+        std::vector<u_char> depth_input = std::vector<u_char>(),
+        const std::string custom = "",
+        const CallOptions &options = CallOptions());
+
+    /**
+     * @brief Enable hedged detect requests.
+     *
+     * @param options hedging options.
+     */
+    void enable_hedging(const HedgeOptions &options = HedgeOptions());
+
+    /**
+     * @brief Disable hedged detect requests, already sent ones are unaffected.
+     */
+    void disable_hedging();
+
+    /**
+     * @brief Get counters of hedged detect requests.
+     *
+     * @return struct of counters.
+     */
+    HedgeStats get_hedge_stats() const;
+
+    /**
+     * @brief Get number of endpoints.
+     *
+     * @return num.
+     */
+    size_t size() const noexcept { return endpoints.size(); }
+
+    /**
+     * @brief Check if an endpoint is in rotation.
+     *
+     * @param index index of endpoint, in the order of ips.
+     * @return true/false.
+     */
+    bool is_healthy(size_t index) const
+    {
+        return endpoints.at(index)->healthy;
+    }
+
+    /**
+     * @brief Get number of requests queued or running on an endpoint.
+     *
+     * @param index index of endpoint, in the order of ips.
+     * @return num.
+     */
+    int get_outstanding(size_t index) const
+    {
+        return endpoints.at(index)->outstanding;
+    }
+
+    /**
+     * @brief Get client of an endpoint, e.g. for calls other than detection.
+     *
+     * @param index index of endpoint, in the order of ips.
+     * @return reference of AsyncAIDKClient.
+     */
+    AsyncAIDKClient &endpoint(size_t index)
+    {
+        return *endpoints.at(index)->client;
+    }
+
+private:
+    struct Endpoint
+    {
+        // requests queued or running, declared first to outlive client
+        std::atomic<int> outstanding{0};
+
+        std::atomic<bool> healthy{true};
+
+        std::unique_ptr<AsyncAIDKClient> client;
+
+        // connection of health checks, only used by the monitor thread
+        std::unique_ptr<AIDKClient> status_client;
+    };
+
+    using SendFunction = std::function<DetectHandle(AsyncAIDKClient &)>;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Attempt
+    {
+        Endpoint *endpoint;
+
+        DetectHandle handle;
+
+        Clock::time_point start;
+    };
+
+    // A request sent with a hedging deadline
+    struct Hedged
+    {
+        std::mutex mutex;
+
+        // handle given to the caller
+        DetectHandle outer;
+
+        SendFunction send;
+
+        // first request and duplicate, if sent
+        std::vector<Attempt> attempts;
+
+        size_t finished = 0;
+
+        bool done = false;
+    };
+
+    // Send a request to the least loaded healthy endpoint
+    DetectHandle dispatch(SendFunction send);
+
+    // Least loaded endpoint, preferring healthy ones, nullptr if all excluded
+    Endpoint *choose(const Endpoint *exclude = nullptr);
+
+    // Send a request to an endpoint, tracking its load and latency
+    DetectHandle send_to(Endpoint &endpoint, const SendFunction &send);
+
+    // Called when the attempt at index of a hedged request finished
+    void on_attempt_finished(const std::shared_ptr<Hedged> &hedged,
+                             size_t index, const DetectHandle &handle);
+
+    // Send the duplicate of a hedged request
+    void hedge(const std::shared_ptr<Hedged> &hedged);
+
+    // Check health of an endpoint until stopping
+    void monitor(Endpoint &endpoint);
+
+    void run_hedge_timers();
+
+    std::vector<std::unique_ptr<Endpoint>> endpoints;
+
+    // rotates the first endpoint considered, to break ties
+    std::atomic<size_t> next_start{0};
+
+    std::chrono::milliseconds health_interval;
+
+    std::mutex mutex;
+
+    std::condition_variable cv;
+
+    bool stopping = false;
+
+    // one per endpoint
+    std::vector<std::thread> monitor_threads;
+
+    // guards everything below
+    mutable std::mutex hedge_mutex;
+
+    std::condition_variable hedge_cv;
+
+    bool hedging = false;
+
+    bool hedge_stopping = false;
+
+    HedgeOptions hedge_options;
+
+    HedgeStats hedge_stats;
+
+    // recent latencies of successful requests, as a ring buffer [second]
+    std::vector<double> latencies;
+
+    size_t latency_pos = 0;
+
+    // pending hedging deadlines
+    std::multimap<Clock::time_point, std::weak_ptr<Hedged>> hedge_timers;
+
+    std::thread hedge_thread;
+};
+
+inline AIDKClientPool::AIDKClientPool(
+    const std::vector<std::string> &ips, float request_timeout,
+    size_t max_in_flight, std::chrono::milliseconds health_interval)
+: health_interval(health_interval)
+{
+    if (ips.empty())
+        throw std::invalid_argument("AIDKClientPool: no endpoint given");
+    for (const auto &ip : ips) {
+        endpoints.emplace_back(new Endpoint());
+        endpoints.back()->client.reset(
+            new AsyncAIDKClient(ip, request_timeout, max_in_flight));
+        endpoints.back()->status_client.reset(
+            new AIDKClient(ip, request_timeout));
+    }
+    for (auto &endpoint : endpoints) {
+        monitor_threads.emplace_back(&AIDKClientPool::monitor, this,
+                                     std::ref(*endpoint));
+    }
+    hedge_thread = std::thread(&AIDKClientPool::run_hedge_timers, this);
+}
+
+inline AIDKClientPool::~AIDKClientPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto &monitor_thread : monitor_threads) {
+        if (monitor_thread.joinable())
+            monitor_thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        hedge_stopping = true;
+        hedge_timers.clear();
+    }
+    hedge_cv.notify_all();
+    if (hedge_thread.joinable())
+        hedge_thread.join();
+
+    // completion callbacks of cancelled requests still use the pool
+    endpoints.clear();
+}
+
+inline DetectHandle AIDKClientPool::detect_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    const std::string command, const std::string custom,
+    const CallOptions &options)
+{
+    // duplicate requests share the deadline and the cancel token
+    return dispatch([=](AsyncAIDKClient &client) {
+        return client.detect_async(obj_name, camera_id, coordinate_id,
+                                   camera_pose, tcp_pose, tcp_force, command,
+                                   custom, options);
+    });
+}
+
+inline DetectHandle AIDKClientPool::detect_with_image_async(
+    const std::string obj_name, const std::string camera_id,
+    const int coordinate_id, const std::vector<double> &camera_pose,
+    const std::vector<double> &camera_intrinsic,
+    const std::vector<double> &tcp_pose, const std::vector<double> &tcp_force,
+    std::vector<u_char> rgb_input, std::vector<u_char> depth_input,
+    const std::string custom, const CallOptions &options)
+{
+    // shared, as a duplicate request sends the same images
+    auto rgb =
+        std::make_shared<const std::vector<u_char>>(std::move(rgb_input));
+    auto depth =
+        std::make_shared<const std::vector<u_char>>(std::move(depth_input));
+    return dispatch([=](AsyncAIDKClient &client) {
+        return client.detect_with_image_async(
+            obj_name, camera_id, coordinate_id, camera_pose, camera_intrinsic,
+            tcp_pose, tcp_force, rgb, depth, custom, options);
+    });
+}
+
+inline void AIDKClientPool::enable_hedging(const HedgeOptions &options)
+{
+    std::lock_guard<std::mutex> lock(hedge_mutex);
+    hedging = true;
+    hedge_options = options;
+    hedge_options.window = std::max<size_t>(hedge_options.window, 1);
+    hedge_options.percentile =
+        std::min(std::max(hedge_options.percentile, 0.0), 1.0);
+}
+
+inline void AIDKClientPool::disable_hedging()
+{
+    std::lock_guard<std::mutex> lock(hedge_mutex);
+    hedging = false;
+}
+
+inline HedgeStats AIDKClientPool::get_hedge_stats() const
+{
+    std::lock_guard<std::mutex> lock(hedge_mutex);
+    return hedge_stats;
+}
+
+inline DetectHandle AIDKClientPool::dispatch(SendFunction send)
+{
+    // hedging deadline from recent latencies
+    Clock::duration delay = Clock::duration::zero();
+    {
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        if (hedging && latencies.size() >= hedge_options.min_samples &&
+            !latencies.empty()) {
+            std::vector<double> sorted = latencies;
+            size_t rank = static_cast<size_t>(
+                std::ceil(hedge_options.percentile * sorted.size()));
+            rank = std::min(std::max<size_t>(rank, 1), sorted.size()) - 1;
+            std::nth_element(sorted.begin(), sorted.begin() + rank,
+                             sorted.end());
+            delay = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(sorted[rank]));
+            hedge_stats.requests++;
+        }
+    }
+
+    Endpoint *endpoint = choose();
+    if (delay == Clock::duration::zero())
+        return send_to(*endpoint, send);
+
+    auto hedged = std::make_shared<Hedged>();
+    hedged->send = std::move(send);
+    hedged->outer = DetectHandle(std::make_shared<detail::DetectState>());
+    DetectHandle first = send_to(*endpoint, hedged->send);
+    {
+        std::lock_guard<std::mutex> lock(hedged->mutex);
+        // id of the first endpoint, as for a request which is not hedged
+        hedged->outer.shared->id = first.id();
+        hedged->attempts.push_back({endpoint, first, Clock::now()});
+    }
+    first.then([this, hedged](const DetectHandle &handle) {
+        on_attempt_finished(hedged, 0, handle);
+    });
+    {
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        hedge_timers.emplace(Clock::now() + delay, hedged);
+    }
+    hedge_cv.notify_one();
+    return hedged->outer;
+}
+
+inline AIDKClientPool::Endpoint *
+AIDKClientPool::choose(const Endpoint *exclude)
+{
+    size_t start = next_start++ % endpoints.size();
+    Endpoint *chosen = nullptr;
+    int least = std::numeric_limits<int>::max();
+    for (int pass = 0; pass < 2 && !chosen; pass++) {
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            auto &endpoint = *endpoints[(start + i) % endpoints.size()];
+            // second pass ignores health, when no endpoint is healthy
+            if (&endpoint == exclude || (pass == 0 && !endpoint.healthy))
+                continue;
+            if (endpoint.outstanding < least) {
+                least = endpoint.outstanding;
+                chosen = &endpoint;
+            }
+        }
+    }
+    return chosen;
+}
+
+inline DetectHandle AIDKClientPool::send_to(Endpoint &endpoint,
+                                            const SendFunction &send)
+{
+    Endpoint *target = &endpoint;
+    auto start = Clock::now();
+    target->outstanding++;
+    DetectHandle handle = send(*target->client);
+    handle.then([this, target, start](const DetectHandle &handle) {
+        target->outstanding--;
+        if (handle.status() != SUCCEEDED)
+            return;
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        double latency =
+            std::chrono::duration<double>(Clock::now() - start).count();
+        if (latencies.size() < hedge_options.window) {
+            latencies.push_back(latency);
+        } else {
+            latencies[latency_pos % latencies.size()] = latency;
+        }
+        latency_pos++;
+    });
+    return handle;
+}
+
+inline void
+AIDKClientPool::on_attempt_finished(const std::shared_ptr<Hedged> &hedged,
+                                    size_t index, const DetectHandle &handle)
+{
+    DetectStatus status = handle.status();
+    std::vector<Attempt> losers;
+    {
+        std::lock_guard<std::mutex> lock(hedged->mutex);
+        hedged->finished++;
+        if (hedged->done)
+            return;
+        // a failure only counts once no other attempt is running
+        if (status != SUCCEEDED &&
+            hedged->finished < hedged->attempts.size())
+            return;
+        hedged->done = true;
+        for (size_t i = 0; i < hedged->attempts.size(); i++) {
+            if (i != index)
+                losers.push_back(hedged->attempts[i]);
+        }
+    }
+
+    bool stopped;
+    {
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        stopped = hedge_stopping;
+        if (status == SUCCEEDED && index > 0)
+            hedge_stats.hedge_won++;
+    }
+
+    // endpoints are being destroyed once stopped, and cancel by themselves
+    if (!stopped) {
+        size_t cancelled = 0;
+        for (auto &loser : losers) {
+            if (loser.endpoint->client->cancel(loser.handle.id()))
+                cancelled++;
+        }
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        hedge_stats.cancelled += cancelled;
+    }
+    hedged->outer.complete(status, handle.result());
+}
+
+inline void AIDKClientPool::hedge(const std::shared_ptr<Hedged> &hedged)
+{
+    bool allow_same_endpoint;
+    {
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        allow_same_endpoint = hedge_options.allow_same_endpoint;
+    }
+
+    DetectHandle duplicate;
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(hedged->mutex);
+        if (hedged->done || hedged->attempts.size() != 1)
+            return;
+        Endpoint *first = hedged->attempts.front().endpoint;
+        Endpoint *endpoint = choose(first);
+        if (!endpoint && allow_same_endpoint)
+            endpoint = first;
+        if (!endpoint)
+            return;
+        duplicate = send_to(*endpoint, hedged->send);
+        index = hedged->attempts.size();
+        hedged->attempts.push_back({endpoint, duplicate, Clock::now()});
+    }
+    {
+        std::lock_guard<std::mutex> lock(hedge_mutex);
+        hedge_stats.hedged++;
+    }
+    duplicate.then([this, hedged, index](const DetectHandle &handle) {
+        on_attempt_finished(hedged, index, handle);
+    });
+}
+
+inline void AIDKClientPool::run_hedge_timers()
+{
+    std::unique_lock<std::mutex> lock(hedge_mutex);
+    while (!hedge_stopping) {
+        if (hedge_timers.empty()) {
+            hedge_cv.wait(lock);
+        } else {
+            // copied, the timer may be erased while waiting
+            auto deadline = hedge_timers.begin()->first;
+            hedge_cv.wait_until(lock, deadline);
+        }
+
+        std::vector<std::shared_ptr<Hedged>> due;
+        auto now = Clock::now();
+        while (!hedge_timers.empty() && hedge_timers.begin()->first <= now) {
+            if (auto hedged = hedge_timers.begin()->second.lock())
+                due.push_back(std::move(hedged));
+            hedge_timers.erase(hedge_timers.begin());
+        }
+        lock.unlock();
+        for (auto &hedged : due) {
+            hedge(hedged);
+        }
+        lock.lock();
+    }
+}
+
+inline void AIDKClientPool::monitor(Endpoint &endpoint)
+{
+    while (true) {
+        AIStatus status = endpoint.status_client->get_current_state();
+        endpoint.healthy = status.status_code != -1 &&
+                           status.status_code != UNKNOWN &&
+                           status.status_code != ERROR;
+        std::unique_lock<std::mutex> lock(mutex);
+        if (cv.wait_for(lock, health_interval, [this] { return stopping; }))
+            return;
+    }
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
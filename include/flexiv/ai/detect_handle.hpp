@@ -0,0 +1,213 @@
+/**
+ * @file detect_handle.hpp
+ * @brief declaration of DetectHandle, handle of an asynchronous detect request
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "flexiv/ai/detection_result.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// define the status of an asynchronous detect request
+enum DetectStatus
+{
+    PENDING = 0,
+    SUCCEEDED,
+    FAILED,
+    CANCELLED,
+    TIMED_OUT
+};
+
+class DetectHandle;
+
+namespace detail {
+
+// Shared state between a DetectHandle and the thread completing it
+struct DetectState
+{
+    // request id, unique per client
+    uint64_t id = 0;
+
+    std::mutex mutex;
+
+    std::condition_variable cv;
+
+    DetectStatus status = PENDING;
+
+    // results captured when the request succeeded
+    DetectionResultPtr result;
+
+    // completion callbacks, run once by the completing thread
+    std::vector<std::function<void(const DetectHandle &)>> callbacks;
+};
+
+} /* namespace detail */
+
+class DetectHandle
+{
+public:
+    /**
+     * @brief Construct an empty handle, not bound to any request.
+     */
+    DetectHandle() = default;
+
+    /**
+     * @brief Check if the handle is bound to a request.
+     *
+     * @return true/false.
+     */
+    bool valid() const noexcept { return shared != nullptr; }
+
+    /**
+     * @brief Get id of the request, used to read its results from the
+     * client.
+     *
+     * @return request id, 0 for an empty handle.
+     */
+    uint64_t id() const noexcept { return shared ? shared->id : 0; }
+
+    /**
+     * @brief Check if the request has finished, without blocking.
+     *
+     * @return true/false.
+     */
+    bool ready() const noexcept { return status() != PENDING; }
+
+    /**
+     * @brief Get current status of the request, without blocking.
+     *
+     * @return DetectStatus enum.
+     */
+    DetectStatus status() const noexcept
+    {
+        if (!shared)
+            return CANCELLED;
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->status;
+    }
+
+    /**
+     * @brief Get results of the request, without blocking.
+     *
+     * @return shared snapshot, nullptr unless the request succeeded.
+     */
+    DetectionResultPtr result() const noexcept
+    {
+        if (!shared)
+            return nullptr;
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->result;
+    }
+
+    /**
+     * @brief Block until the request has finished.
+     *
+     * @return success or not of detection request.
+     */
+    bool wait() const
+    {
+        if (!shared)
+            return false;
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->cv.wait(lock, [this] { return shared->status != PENDING; });
+        return shared->status == SUCCEEDED;
+    }
+
+    /**
+     * @brief Block until the request has finished or the deadline is reached.
+     *
+     * @param deadline absolute time point to give up waiting.
+     * @return true if the request finished before the deadline.
+     */
+    template <typename Clock, typename Duration>
+    bool wait_until(
+        const std::chrono::time_point<Clock, Duration> &deadline) const
+    {
+        if (!shared)
+            return true;
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        return shared->cv.wait_until(
+            lock, deadline, [this] { return shared->status != PENDING; });
+    }
+
+    /**
+     * @brief Block until the request has finished or the timeout elapsed.
+     *
+     * @param timeout relative time to give up waiting.
+     * @return true if the request finished within the timeout.
+     */
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period> &timeout) const
+    {
+        return wait_until(std::chrono::steady_clock::now() + timeout);
+    }
+
+    /**
+     * @brief Attach a completion callback. If the request has already
+     * finished, the callback runs immediately on the calling thread, otherwise
+     * it runs on the thread finishing the request, after waiters have been
+     * woken up. Callbacks must not block for long, nor throw.
+     *
+     * @param callback function called with this handle.
+     */
+    void then(std::function<void(const DetectHandle &)> callback) const
+    {
+        if (!shared)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->status == PENDING) {
+                shared->callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback(*this);
+    }
+
+private:
+    friend class AsyncAIDKClient;
+    friend class AIDKClientPool;
+
+    explicit DetectHandle(std::shared_ptr<detail::DetectState> state)
+    : shared(std::move(state))
+    {}
+
+    // Mark the request as finished, wake up waiters and run callbacks
+    void complete(DetectStatus status,
+                  DetectionResultPtr result = nullptr) const
+    {
+        std::vector<std::function<void(const DetectHandle &)>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->status != PENDING)
+                return;
+            shared->status = status;
+            shared->result = std::move(result);
+            callbacks.swap(shared->callbacks);
+        }
+        shared->cv.notify_all();
+        for (auto &callback : callbacks) {
+            try {
+                callback(*this);
+            } catch (...) {
+            }
+        }
+    }
+
+    std::shared_ptr<detail::DetectState> shared;
+};
+
+} /* namespace ai */
+} /* namespace flexiv */
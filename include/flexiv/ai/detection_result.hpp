@@ -0,0 +1,683 @@
+/**
+ * @file detection_result.hpp
+ * @brief declaration of DetectionResult, immutable snapshot of a detection
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include "flexiv/ai/aidk.hpp"
+#include "flexiv/ai/views.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// define the result keys of the typed fast path, see DetectionResult
+enum ResultKey
+{
+    KEY_OBJ_POSE = 0,
+    KEY_VALID,
+    KEY_DOUBLE_VALUE,
+    KEY_INT_VALUE,
+    KEY_NAME,
+    KEY_BBOX,
+    KEY_KEYPOINTS,
+    KEY_POSITIONS
+};
+
+// number of ResultKey values
+constexpr size_t RESULT_KEY_NUM = 8;
+
+/**
+ * @brief Get the string of a result key, as in SUPPORTED_KEYS.
+ *
+ * @param key ResultKey enum.
+ * @return string of result key.
+ */
+inline const char *result_key_name(ResultKey key) noexcept
+{
+    static const char *const names[RESULT_KEY_NUM] = {
+        "obj_pose", "valid",    "double_value", "int_value",
+        "name",     "bbox",     "keypoints",    "positions"};
+    return static_cast<size_t>(key) < RESULT_KEY_NUM ? names[key] : "";
+}
+
+/**
+ * @brief Get the result key of a string.
+ *
+ * @param name string of result key.
+ * @param key ResultKey enum, set on success.
+ * @return true if name is a ResultKey.
+ */
+inline bool to_result_key(const std::string &name, ResultKey &key) noexcept
+{
+    for (size_t i = 0; i < RESULT_KEY_NUM; i++) {
+        if (name == result_key_name(static_cast<ResultKey>(i))) {
+            key = static_cast<ResultKey>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Parsed results of all detected objects, owned by the caller and
+ * refilled on every detection by parse_all, reusing its memory.
+ */
+struct ParsedResults
+{
+    // timestamp of detect request in seconds
+    uint64_t detected_time = 0;
+
+    std::vector<std::string> obj_names;
+
+    std::vector<int> obj_nums;
+
+    // per object, by ResultKey, empty if not requested or not parsed
+    std::vector<std::array<std::vector<Result>, RESULT_KEY_NUM>> results;
+
+    // per object, by ResultKey, whether the key was requested and parsed
+    std::vector<std::array<bool, RESULT_KEY_NUM>> parsed;
+
+    /**
+     * @brief Function to get parsed data of all instances of an object.
+     *
+     * @param obj_index index of object in obj_names.
+     * @param key ResultKey enum.
+     * @return pointer of vector of struct Result, nullptr if not parsed.
+     */
+    const std::vector<Result> *find(size_t obj_index,
+                                    ResultKey key) const noexcept
+    {
+        if (obj_index >= parsed.size()
+            || static_cast<size_t>(key) >= RESULT_KEY_NUM
+            || !parsed[obj_index][key])
+            return nullptr;
+        return &results[obj_index][key];
+    }
+};
+
+/**
+ * @brief Parse the given keys of all objects of the last detection of a
+ * client in one pass, into reusable caller memory.
+ *
+ * @param client client of the last detect request.
+ * @param keys result keys to parse, the others are left empty.
+ * @param parsed parsed results, previous content is replaced.
+ * @return true if every key of every object was parsed.
+ */
+inline bool parse_all(AIDKClient &client, const std::vector<ResultKey> &keys,
+                      ParsedResults &parsed);
+
+class DetectionResult;
+
+// Shared, read-only detection result
+using DetectionResultPtr = std::shared_ptr<const DetectionResult>;
+
+/**
+ * @brief Snapshot of all results of one detect request.
+ *
+ * A snapshot is built once right after detection and never modified, so any
+ * number of threads can read the same instance through a DetectionResultPtr
+ * without locking, while the client goes on with the next detection.
+ *
+ * For high-rate loops, results are also reached by object index and
+ * ResultKey, and typed getters write into caller storage, with no string
+ * lookup and no heap allocation:
+ *     int obj = result->find_obj("box");
+ *     Pose pose;
+ *     bool ok = obj >= 0 && result->get_pose(obj, 0, pose);
+ *
+ * To read every key of every object at once, parse_all fills a ParsedResults
+ * kept by the caller across detections.
+ */
+class DetectionResult
+{
+public:
+    /**
+     * @brief Read all results of the last detect request out of a client.
+     * Must be called before the client starts the next detection.
+     *
+     * @param client client which just finished a detect request.
+     * @param coordinate_id result coordinate space id of the request.
+     * @return shared snapshot.
+     */
+    static DetectionResultPtr capture(AIDKClient &client,
+                                      int coordinate_id = 0);
+
+    /**
+     * @brief Get timestamp of detect request.
+     *
+     * @return timestamp in seconds.
+     */
+    uint64_t get_detected_time() const noexcept { return detected_time; }
+
+    /**
+     * @brief Function to get all detected object names.
+     *
+     * @return vector of object names.
+     */
+    const std::vector<std::string> &get_detected_obj_names() const noexcept
+    {
+        return obj_names;
+    }
+
+    /**
+     * @brief Function to get all detected object nums.
+     *
+     * @return vector of object nums.
+     */
+    const std::vector<int> &get_detected_obj_nums() const noexcept
+    {
+        return obj_nums;
+    }
+
+    /**
+     * @brief Function to get detected object number based of object name.
+     *
+     * @param obj_name string of object name.
+     * @return num.
+     */
+    int get_detected_obj_num(const std::string &obj_name) const noexcept;
+
+    /**
+     * @brief Function to get state of all detected objects.
+     *
+     * @return vector of ObjState, one per object name.
+     */
+    const std::vector<ObjState> &get_obj_states() const noexcept
+    {
+        return obj_states;
+    }
+
+    /**
+     * @brief Function to get state of a detected object.
+     *
+     * @param obj_name string of object name.
+     * @return pointer of ObjState, nullptr if not detected.
+     */
+    const ObjState *get_obj_state(const std::string &obj_name) const noexcept;
+
+    /**
+     * @brief Function to get parsed data of all instances of an object,
+     * without copying.
+     *
+     * @param obj_name string of object name.
+     * @param key string of result key, one of SUPPORTED_KEYS.
+     * @return pointer of vector of struct Result, nullptr if not available.
+     */
+    const std::vector<Result> *
+    find_result(const std::string &obj_name,
+                const std::string &key) const noexcept;
+
+    /**
+     * @brief Function to parse detection result, same as
+     * AIDKClient::parse_result.
+     *
+     * @param obj_name string of object name.
+     * @param key string of result key, one of SUPPORTED_KEYS.
+     * @param index indexed data or all data, -1 means get all data.
+     * @param result vector of struct Result
+     * @return true/false.
+     */
+    bool parse_result(const std::string &obj_name, const std::string &key,
+                      int index, std::vector<Result> &result) const;
+
+    /**
+     * @brief Parse the given keys of all objects in one pass, into reusable
+     * caller memory, see flexiv::ai::parse_all.
+     *
+     * @param keys result keys to parse, the others are left empty.
+     * @param parsed parsed results, previous content is replaced.
+     * @return true if every key of every object was parsed.
+     */
+    bool parse_all(const std::vector<ResultKey> &keys,
+                   ParsedResults &parsed) const;
+
+    /**
+     * @brief Function to get index of a detected object, for the getters by
+     * index.
+     *
+     * @param obj_name string of object name.
+     * @return index in get_detected_obj_names, -1 if not detected.
+     */
+    int find_obj(const std::string &obj_name) const noexcept;
+
+    /**
+     * @brief Function to get parsed data of all instances of an object by
+     * index and key, without copying.
+     *
+     * @param obj_index index of object, see find_obj.
+     * @param key ResultKey enum.
+     * @return pointer of vector of struct Result, nullptr if not available.
+     */
+    const std::vector<Result> *find_result(size_t obj_index,
+                                           ResultKey key) const noexcept;
+
+    /**
+     * @brief Function to get object pose of an instance.
+     *
+     * @param obj_index index of object, see find_obj.
+     * @param instance index of instance.
+     * @param pose object pose [x, y, z, qw, qx, qy, qz], set on success.
+     * @return true/false.
+     */
+    bool get_pose(size_t obj_index, size_t instance,
+                  Pose &pose) const noexcept;
+
+    /**
+     * @brief Function to get valid flag of an instance.
+     *
+     * @param obj_index index of object, see find_obj.
+     * @param instance index of instance.
+     * @param valid valid flag, set on success.
+     * @return true/false.
+     */
+    bool get_valid(size_t obj_index, size_t instance,
+                   bool &valid) const noexcept;
+
+    /**
+     * @brief Function to get double value of an instance.
+     *
+     * @param obj_index index of object, see find_obj.
+     * @param instance index of instance.
+     * @param value double value, set on success.
+     * @return true/false.
+     */
+    bool get_double_value(size_t obj_index, size_t instance,
+                          double &value) const noexcept;
+
+    /**
+     * @brief Function to get int value of an instance.
+     *
+     * @param obj_index index of object, see find_obj.
+     * @param instance index of instance.
+     * @param value int value, set on success.
+     * @return true/false.
+     */
+    bool get_int_value(size_t obj_index, size_t instance,
+                       int &value) const noexcept;
+
+    /**
+     * @brief Copy of this result with image coordinates mapped, e.g. from a
+     * cropped or downscaled image back to the full frame. Only bbox and
+     * keypoints are image coordinates, positions and poses are kept.
+     *
+     * @param mapping function mapping an image point [u, v] in place.
+     * @return shared snapshot.
+     */
+    DetectionResultPtr map_image_points(
+        const std::function<void(double &u, double &v)> &mapping) const;
+
+private:
+    // Parsed data of all instances of one object
+    struct ObjResults
+    {
+        // by ResultKey, valid if parsed
+        std::array<std::vector<Result>, RESULT_KEY_NUM> known;
+
+        std::array<bool, RESULT_KEY_NUM> parsed {};
+
+        // keys of SUPPORTED_KEYS which are not a ResultKey
+        std::unordered_map<std::string, std::vector<Result>> others;
+    };
+
+    DetectionResult() = default;
+
+    // Result of an instance by index and key, nullptr if not available
+    const Result *find_instance(size_t obj_index, ResultKey key,
+                                size_t instance) const noexcept;
+
+    uint64_t detected_time = 0;
+
+    std::vector<std::string> obj_names;
+
+    std::vector<int> obj_nums;
+
+    // one per object name, in the order of obj_names
+    std::vector<ObjState> obj_states;
+
+    // parsed data of all instances, in the order of obj_names
+    std::vector<ObjResults> results;
+};
+
+inline DetectionResultPtr DetectionResult::capture(AIDKClient &client,
+                                                   int coordinate_id)
+{
+    std::shared_ptr<DetectionResult> snapshot(new DetectionResult());
+    snapshot->detected_time = client.get_detected_time();
+    snapshot->obj_names = client.get_detected_obj_names();
+    snapshot->obj_nums = client.get_detected_obj_nums();
+    snapshot->obj_states.resize(snapshot->obj_names.size());
+    snapshot->results.resize(snapshot->obj_names.size());
+
+    for (size_t i = 0; i < snapshot->obj_names.size(); i++) {
+        const auto &obj_name = snapshot->obj_names[i];
+        auto &obj_results = snapshot->results[i];
+        for (const auto &name : SUPPORTED_KEYS) {
+            std::vector<Result> parsed;
+            if (!client.parse_result(obj_name, name, -1, parsed))
+                continue;
+            ResultKey key;
+            if (to_result_key(name, key)) {
+                obj_results.known[key] = std::move(parsed);
+                obj_results.parsed[key] = true;
+            } else {
+                obj_results.others.emplace(name, std::move(parsed));
+            }
+        }
+
+        // rebuild meta data of every instance from the parsed keys
+        auto &state = snapshot->obj_states[i];
+        state.obj_name = obj_name;
+        state.synced_timestamp = static_cast<double>(snapshot->detected_time);
+        size_t num = i < snapshot->obj_nums.size()
+                         ? static_cast<size_t>(snapshot->obj_nums[i])
+                         : 0;
+        for (const auto &known : obj_results.known) {
+            num = std::max(num, known.size());
+        }
+        for (const auto &pair : obj_results.others) {
+            num = std::max(num, pair.second.size());
+        }
+        state.obj_meta_data.resize(num);
+        for (auto &meta : state.obj_meta_data) {
+            meta.coordinate_id = coordinate_id;
+        }
+        for (size_t k = 0; k < RESULT_KEY_NUM; k++) {
+            const auto &all = obj_results.known[k];
+            for (size_t j = 0; j < all.size(); j++) {
+                const auto &result = all[j];
+                auto &meta = state.obj_meta_data[j];
+                switch (static_cast<ResultKey>(k)) {
+                    case KEY_VALID:
+                        meta.is_valid = result.valid;
+                        break;
+                    case KEY_DOUBLE_VALUE:
+                        meta.double_value = result.double_value;
+                        break;
+                    case KEY_INT_VALUE:
+                        meta.int_value = result.int_value;
+                        break;
+                    case KEY_NAME:
+                        meta.name = result.name;
+                        break;
+                    case KEY_OBJ_POSE:
+                        if (!result.vect.empty())
+                            meta.obj_pose = result.vect.front();
+                        break;
+                    case KEY_KEYPOINTS:
+                        meta.img_pts = result.vect;
+                        break;
+                    case KEY_POSITIONS:
+                        meta.img_pts_pos = result.vect;
+                        break;
+                    case KEY_BBOX: {
+                        // [xmin, ymin, xmax, ymax], flat or split in two
+                        // points
+                        std::vector<int> corners;
+                        for (const auto &v : result.vect) {
+                            for (double c : v) {
+                                corners.push_back(static_cast<int>(c));
+                            }
+                        }
+                        if (corners.size() >= 4) {
+                            meta.bbox_min = {corners[0], corners[1]};
+                            meta.bbox_max = {corners[2], corners[3]};
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return snapshot;
+}
+
+inline int DetectionResult::get_detected_obj_num(
+    const std::string &obj_name) const noexcept
+{
+    for (size_t i = 0; i < obj_names.size() && i < obj_nums.size(); i++) {
+        if (obj_names[i] == obj_name)
+            return obj_nums[i];
+    }
+    return 0;
+}
+
+inline const ObjState *
+DetectionResult::get_obj_state(const std::string &obj_name) const noexcept
+{
+    for (const auto &state : obj_states) {
+        if (state.obj_name == obj_name)
+            return &state;
+    }
+    return nullptr;
+}
+
+inline const std::vector<Result> *
+DetectionResult::find_result(const std::string &obj_name,
+                             const std::string &key) const noexcept
+{
+    int obj_index = find_obj(obj_name);
+    if (obj_index < 0)
+        return nullptr;
+    ResultKey known;
+    if (to_result_key(key, known))
+        return find_result(static_cast<size_t>(obj_index), known);
+    const auto &others = results[obj_index].others;
+    auto it = others.find(key);
+    return it == others.end() ? nullptr : &it->second;
+}
+
+inline int DetectionResult::find_obj(const std::string &obj_name) const noexcept
+{
+    for (size_t i = 0; i < obj_names.size(); i++) {
+        if (obj_names[i] == obj_name)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+inline const std::vector<Result> *
+DetectionResult::find_result(size_t obj_index, ResultKey key) const noexcept
+{
+    if (obj_index >= results.size()
+        || static_cast<size_t>(key) >= RESULT_KEY_NUM
+        || !results[obj_index].parsed[key])
+        return nullptr;
+    return &results[obj_index].known[key];
+}
+
+inline const Result *DetectionResult::find_instance(
+    size_t obj_index, ResultKey key, size_t instance) const noexcept
+{
+    const auto *all = find_result(obj_index, key);
+    if (!all || instance >= all->size())
+        return nullptr;
+    return &(*all)[instance];
+}
+
+inline bool DetectionResult::get_pose(size_t obj_index, size_t instance,
+                                      Pose &pose) const noexcept
+{
+    const auto *result = find_instance(obj_index, KEY_OBJ_POSE, instance);
+    if (!result || result->vect.empty()
+        || result->vect.front().size() != pose.size())
+        return false;
+    std::copy(result->vect.front().begin(), result->vect.front().end(),
+              pose.begin());
+    return true;
+}
+
+inline bool DetectionResult::get_valid(size_t obj_index, size_t instance,
+                                       bool &valid) const noexcept
+{
+    const auto *result = find_instance(obj_index, KEY_VALID, instance);
+    if (!result)
+        return false;
+    valid = result->valid;
+    return true;
+}
+
+inline bool DetectionResult::get_double_value(size_t obj_index,
+                                              size_t instance,
+                                              double &value) const noexcept
+{
+    const auto *result = find_instance(obj_index, KEY_DOUBLE_VALUE, instance);
+    if (!result)
+        return false;
+    value = result->double_value;
+    return true;
+}
+
+inline bool DetectionResult::get_int_value(size_t obj_index, size_t instance,
+                                           int &value) const noexcept
+{
+    const auto *result = find_instance(obj_index, KEY_INT_VALUE, instance);
+    if (!result)
+        return false;
+    value = result->int_value;
+    return true;
+}
+
+inline bool DetectionResult::parse_result(const std::string &obj_name,
+                                          const std::string &key, int index,
+                                          std::vector<Result> &result) const
+{
+    result.clear();
+    const auto *all = find_result(obj_name, key);
+    if (!all)
+        return false;
+    if (index < 0) {
+        result = *all;
+        return true;
+    }
+    if (static_cast<size_t>(index) >= all->size())
+        return false;
+    result.push_back((*all)[index]);
+    return true;
+}
+
+namespace detail {
+
+// Size the per-object slots of parsed results, keeping their memory, and
+// mark every key as not parsed
+inline void reset_parsed(size_t obj_num, ParsedResults &parsed)
+{
+    parsed.results.resize(obj_num);
+    parsed.parsed.resize(obj_num);
+    for (size_t i = 0; i < obj_num; i++) {
+        for (auto &all : parsed.results[i]) {
+            all.clear();
+        }
+        parsed.parsed[i].fill(false);
+    }
+}
+
+} /* namespace detail */
+
+inline bool DetectionResult::parse_all(const std::vector<ResultKey> &keys,
+                                       ParsedResults &parsed) const
+{
+    parsed.detected_time = detected_time;
+    parsed.obj_names.assign(obj_names.begin(), obj_names.end());
+    parsed.obj_nums.assign(obj_nums.begin(), obj_nums.end());
+    detail::reset_parsed(obj_names.size(), parsed);
+
+    bool all_parsed = true;
+    for (size_t i = 0; i < obj_names.size(); i++) {
+        for (ResultKey key : keys) {
+            const auto *all = find_result(i, key);
+            if (!all) {
+                all_parsed = false;
+                continue;
+            }
+            // element-wise copy, reusing the memory of the previous results
+            parsed.results[i][key].assign(all->begin(), all->end());
+            parsed.parsed[i][key] = true;
+        }
+    }
+    return all_parsed;
+}
+
+inline bool parse_all(AIDKClient &client, const std::vector<ResultKey> &keys,
+                      ParsedResults &parsed)
+{
+    parsed.detected_time = client.get_detected_time();
+    parsed.obj_names = client.get_detected_obj_names();
+    parsed.obj_nums = client.get_detected_obj_nums();
+    detail::reset_parsed(parsed.obj_names.size(), parsed);
+
+    bool all_parsed = true;
+    for (size_t i = 0; i < parsed.obj_names.size(); i++) {
+        for (ResultKey key : keys) {
+            if (static_cast<size_t>(key) >= RESULT_KEY_NUM) {
+                all_parsed = false;
+                continue;
+            }
+            auto &all = parsed.results[i][key];
+            parsed.parsed[i][key] = client.parse_result(
+                parsed.obj_names[i], result_key_name(key), -1, all);
+            if (!parsed.parsed[i][key]) {
+                all.clear();
+                all_parsed = false;
+            }
+        }
+    }
+    return all_parsed;
+}
+
+inline DetectionResultPtr DetectionResult::map_image_points(
+    const std::function<void(double &u, double &v)> &mapping) const
+{
+    std::shared_ptr<DetectionResult> mapped(new DetectionResult(*this));
+
+    // flat [u, v, u, v, ...], as bbox and keypoints are sent
+    auto map_flat = [&](std::vector<double> &values) {
+        for (size_t j = 0; j + 1 < values.size(); j += 2) {
+            mapping(values[j], values[j + 1]);
+        }
+    };
+    for (auto &obj_results : mapped->results) {
+        for (ResultKey key : {KEY_BBOX, KEY_KEYPOINTS}) {
+            for (auto &result : obj_results.known[key]) {
+                for (auto &values : result.vect) {
+                    map_flat(values);
+                }
+            }
+        }
+    }
+
+    for (auto &state : mapped->obj_states) {
+        for (auto &meta : state.obj_meta_data) {
+            for (auto &point : meta.img_pts) {
+                map_flat(point);
+            }
+            if (meta.bbox_min.size() >= 2 && meta.bbox_max.size() >= 2) {
+                double corners[4] = {
+                    static_cast<double>(meta.bbox_min[0]),
+                    static_cast<double>(meta.bbox_min[1]),
+                    static_cast<double>(meta.bbox_max[0]),
+                    static_cast<double>(meta.bbox_max[1])};
+                mapping(corners[0], corners[1]);
+                mapping(corners[2], corners[3]);
+                meta.bbox_min = {static_cast<int>(std::lround(corners[0])),
+                                 static_cast<int>(std::lround(corners[1]))};
+                meta.bbox_max = {static_cast<int>(std::lround(corners[2])),
+                                 static_cast<int>(std::lround(corners[3]))};
+            }
+        }
+    }
+    return mapped;
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
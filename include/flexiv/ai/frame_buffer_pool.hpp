@@ -0,0 +1,200 @@
+/**
+ * @file frame_buffer_pool.hpp
+ * @brief declaration of FrameBufferPool, reusable buffers of encoded images
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace flexiv {
+namespace ai {
+
+// Buffer of an encoded image lent by a FrameBufferPool, back to the pool once
+// the last copy is released
+using FrameBuffer = std::shared_ptr<std::vector<u_char>>;
+
+/**
+ * @brief Pool of buffers of encoded images, so that steady-state detect
+ * requests allocate no large buffer.
+ *
+ * A buffer is lent empty, keeping the capacity of its previous use, and is
+ * returned as soon as the last copy of its FrameBuffer is released, e.g. when
+ * the request sending it is done. Buffers are pre-sized to the largest size
+ * seen so far. Buffers stay std::vector<u_char>, as AIDKClient sends them, so
+ * their memory comes from the standard allocator, which on Linux maps large
+ * sizes to pages of their own.
+ *
+ * Thread safety: every member function can be called concurrently, and a
+ * buffer can be released on any thread, even after the pool is destroyed.
+ */
+class FrameBufferPool
+{
+public:
+    /**
+     * @brief Constructor of pool.
+     *
+     * @param buffer_size initial capacity of new buffers in bytes, 0 to learn
+     * it from use.
+     * @param max_idle maximum number of idle buffers kept, buffers returned
+     * beyond are freed.
+     * @param huge_pages whether to advise the kernel to back buffers with
+     * transparent huge pages.
+     */
+    explicit FrameBufferPool(size_t buffer_size = 0, size_t max_idle = 8,
+                             bool huge_pages = false);
+
+    FrameBufferPool(const FrameBufferPool &) = delete;
+    FrameBufferPool &operator=(const FrameBufferPool &) = delete;
+
+    /**
+     * @brief Borrow an empty buffer, reused if one is idle.
+     *
+     * @return buffer, returned to the pool when its last copy is released.
+     */
+    FrameBuffer acquire();
+
+    /**
+     * @brief Get number of idle buffers.
+     *
+     * @return number of buffers.
+     */
+    size_t get_num_idle() const;
+
+    /**
+     * @brief Get number of buffers allocated since construction, a steady
+     * count means no more allocation.
+     *
+     * @return number of buffers.
+     */
+    size_t get_num_allocated() const;
+
+private:
+    // Shared with lent buffers, which may outlive the pool
+    struct State
+    {
+        mutable std::mutex mutex;
+
+        std::vector<std::unique_ptr<std::vector<u_char>>> idle;
+
+        size_t buffer_size = 0;
+
+        size_t max_idle = 0;
+
+        size_t allocated = 0;
+
+        bool huge_pages = false;
+    };
+
+    // Take a buffer back, or free it
+    static void release(const std::weak_ptr<State> &weak,
+                        std::vector<u_char> *buffer);
+
+    // Advise huge pages on the whole pages of a buffer
+    static void advise_huge_pages(std::vector<u_char> &buffer);
+
+    std::shared_ptr<State> state;
+};
+
+inline FrameBufferPool::FrameBufferPool(size_t buffer_size, size_t max_idle,
+                                        bool huge_pages)
+: state(std::make_shared<State>())
+{
+    state->buffer_size = buffer_size;
+    state->max_idle = max_idle;
+    state->huge_pages = huge_pages;
+}
+
+inline FrameBuffer FrameBufferPool::acquire()
+{
+    std::unique_ptr<std::vector<u_char>> buffer;
+    size_t buffer_size = 0;
+    bool huge_pages = false;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->idle.empty()) {
+            buffer = std::move(state->idle.back());
+            state->idle.pop_back();
+        } else {
+            state->allocated++;
+            buffer_size = state->buffer_size;
+            huge_pages = state->huge_pages;
+        }
+    }
+
+    // allocate outside of the lock
+    if (!buffer) {
+        buffer.reset(new std::vector<u_char>());
+        buffer->reserve(buffer_size);
+        if (huge_pages)
+            advise_huge_pages(*buffer);
+    }
+
+    std::weak_ptr<State> weak = state;
+    return FrameBuffer(buffer.release(), [weak](std::vector<u_char> *lent) {
+        release(weak, lent);
+    });
+}
+
+inline size_t FrameBufferPool::get_num_idle() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->idle.size();
+}
+
+inline size_t FrameBufferPool::get_num_allocated() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->allocated;
+}
+
+inline void FrameBufferPool::release(const std::weak_ptr<State> &weak,
+                                     std::vector<u_char> *lent)
+{
+    std::unique_ptr<std::vector<u_char>> buffer(lent);
+    auto state = weak.lock();
+    if (!state)
+        return;
+    buffer->clear();
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->idle.size() >= state->max_idle)
+        return;
+    if (buffer->capacity() > state->buffer_size) {
+        state->buffer_size = buffer->capacity();
+
+        // regrown by its user into fresh memory, so advised again
+        if (state->huge_pages)
+            advise_huge_pages(*buffer);
+    }
+    state->idle.push_back(std::move(buffer));
+}
+
+inline void FrameBufferPool::advise_huge_pages(std::vector<u_char> &buffer)
+{
+#ifdef MADV_HUGEPAGE
+    if (buffer.capacity() == 0)
+        return;
+    auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    auto begin = reinterpret_cast<uintptr_t>(buffer.data());
+    auto end = begin + buffer.capacity();
+    begin = (begin + page - 1) / page * page;
+    end = end / page * page;
+    if (begin < end)
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE);
+#else
+    (void)buffer;
+#endif
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
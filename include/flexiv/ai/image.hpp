@@ -0,0 +1,748 @@
+/**
+ * @file image.hpp
+ * @brief declaration of raw image input and its encoding for detect requests
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <sys/types.h>
+
+#include <zlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+// SSE4.1 and AVX2 kernels, compiled for their own target and chosen at run
+// time, so every translation unit has the same definitions whatever its -m
+// flags
+#define FLEXIV_AIDK_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef FLEXIV_AIDK_WITH_JPEG
+#include <jpeglib.h>
+#endif
+
+namespace flexiv {
+namespace ai {
+
+// define the pixel formats of raw images
+enum PixelFormat
+{
+    BGR8 = 0,
+    RGB8,
+    Z16,
+    Z32F
+};
+
+// Non-owning view of raw camera pixels
+struct RawImage
+{
+    // first pixel of the first row
+    const void *data = nullptr;
+
+    int width = 0;
+
+    int height = 0;
+
+    // bytes between two rows, 0 if rows are packed
+    size_t stride = 0;
+
+    PixelFormat format = BGR8;
+
+    // Z16 units per Z32F unit, meters to millimeters by default
+    float depth_scale = 1000.0f;
+};
+
+/**
+ * @brief Get size of one pixel of a format.
+ *
+ * @param format pixel format.
+ * @return size in bytes.
+ */
+inline size_t bytes_per_pixel(PixelFormat format)
+{
+    switch (format) {
+        case BGR8:
+        case RGB8:
+            return 3;
+        case Z16:
+            return 2;
+        case Z32F:
+            return 4;
+    }
+    return 0;
+}
+
+// define the codecs of encoded images
+enum ImageCodec
+{
+    // PNG with run-length deflate, fast and lossless
+    FAST_LOSSLESS = 0,
+    // PNG at a chosen deflate level
+    PNG,
+    // JPEG, lossy, color only, needs FLEXIV_AIDK_WITH_JPEG
+    JPEG,
+    // PNG with stored deflate blocks, for a NoemaEdge on the same host
+    UNCOMPRESSED
+};
+
+// Options of image encoding
+struct EncodeOptions
+{
+    ImageCodec codec = FAST_LOSSLESS;
+
+    // PNG deflate level, 0 (stored) to 9 (smallest)
+    int level = 6;
+
+    // JPEG quality, 1 to 100
+    int quality = 90;
+};
+
+/**
+ * @brief Encode a raw image for detect_with_image on the calling thread. Color
+ * is encoded as 8-bit RGB, depth as 16-bit grayscale, Z32F being converted to
+ * Z16 with depth_scale. Invalid depth maps to 0. See ImageEncoder for
+ * multi-threaded encoding.
+ *
+ * @param image raw image, only read during the call.
+ * @param encoded encoded image, replaced.
+ * @param options codec and its level or quality.
+ * @throw std::invalid_argument if image is empty or malformed, or if the codec
+ * does not suit the image.
+ */
+void encode_image(const RawImage &image, std::vector<u_char> &encoded,
+                  const EncodeOptions &options = EncodeOptions());
+
+/**
+ * @brief Check if a NoemaEdge ip is on the same host, i.e. localhost or a
+ * loopback address, IPv4-mapped ones included.
+ *
+ * @param ip string of AI Noema App ip.
+ * @return true/false.
+ */
+bool is_loopback_host(const std::string &ip);
+
+/**
+ * @brief Get encode options suited to a NoemaEdge host. Images to the same
+ * host only cross the loopback, where copying bytes is cheaper than
+ * compressing them, so they are UNCOMPRESSED. Other hosts get the default
+ * FAST_LOSSLESS.
+ *
+ * @param ip string of AI Noema App ip.
+ * @return encode options.
+ */
+EncodeOptions encode_options_for_host(const std::string &ip);
+
+namespace detail {
+
+inline void check_image(const RawImage &image)
+{
+    if (!image.data || image.width <= 0 || image.height <= 0)
+        throw std::invalid_argument("encode_image: empty image");
+    size_t row_bytes = static_cast<size_t>(image.width)
+                       * bytes_per_pixel(image.format);
+    if (row_bytes == 0)
+        throw std::invalid_argument("encode_image: unknown pixel format");
+    if (image.stride != 0 && image.stride < row_bytes)
+        throw std::invalid_argument("encode_image: stride below row size");
+}
+
+inline bool is_depth(const RawImage &image)
+{
+    return image.format == Z16 || image.format == Z32F;
+}
+
+inline const uint8_t *image_row(const RawImage &image, int y)
+{
+    size_t stride = image.stride != 0 ? image.stride
+                                      : static_cast<size_t>(image.width)
+                                            * bytes_per_pixel(image.format);
+    return static_cast<const uint8_t *>(image.data) + stride * y;
+}
+
+// Size of one converted row, see convert_row
+inline size_t encoded_row_bytes(const RawImage &image)
+{
+    return static_cast<size_t>(image.width) * (is_depth(image) ? 2 : 3);
+}
+
+inline void put_u32(uint8_t *out, uint32_t value)
+{
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+// Append a PNG chunk with its length and CRC
+inline void append_chunk(std::vector<u_char> &png, const char type[4],
+                         const uint8_t *data, size_t size)
+{
+    size_t start = png.size();
+    png.resize(start + 12 + size);
+    put_u32(&png[start], static_cast<uint32_t>(size));
+    std::memcpy(&png[start + 4], type, 4);
+    if (size > 0)
+        std::memcpy(&png[start + 8], data, size);
+    uint32_t crc = crc32(0L, &png[start + 4], static_cast<uInt>(size + 4));
+    put_u32(&png[start + 8 + size], crc);
+}
+
+// SIMD instruction sets of the running CPU
+enum SimdLevel
+{
+    SIMD_NONE = 0,
+    SIMD_SSE41,
+    SIMD_AVX2
+};
+
+// Get SIMD instruction sets of the running CPU, checked once
+inline SimdLevel simd_level()
+{
+#ifdef FLEXIV_AIDK_X86_SIMD
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SIMD_AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return SIMD_SSE41;
+        return SIMD_NONE;
+    }();
+    return level;
+#else
+    return SIMD_NONE;
+#endif
+}
+
+#ifdef FLEXIV_AIDK_X86_SIMD
+// Byte swap of whole vectors of 16-bit samples, returns samples done
+__attribute__((target("avx2"))) inline size_t
+swap_bytes_16_avx2(const uint8_t *in, uint8_t *out, size_t count)
+{
+    const __m256i order = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4,
+        7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(in + 2 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i),
+                            _mm256_shuffle_epi8(v, order));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) inline size_t
+swap_bytes_16_sse41(const uint8_t *in, uint8_t *out, size_t count)
+{
+    const __m128i order =
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                         _mm_shuffle_epi8(v, order));
+    }
+    return i;
+}
+#endif
+
+// Swap bytes of 16-bit little-endian samples, PNG stores them big-endian
+inline void swap_bytes_16(const uint8_t *in, uint8_t *out, size_t count)
+{
+    size_t i = 0;
+#ifdef FLEXIV_AIDK_X86_SIMD
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            i = swap_bytes_16_avx2(in, out, count);
+            break;
+        case SIMD_SSE41:
+            i = swap_bytes_16_sse41(in, out, count);
+            break;
+        case SIMD_NONE:
+            break;
+    }
+#endif
+    for (; i < count; i++) {
+        out[2 * i] = in[2 * i + 1];
+        out[2 * i + 1] = in[2 * i];
+    }
+}
+
+// PNG Paeth predictor of a byte from its left, upper and upper-left bytes
+inline uint8_t paeth_predict(int a, int b, int c)
+{
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - 2 * c);
+    if (pa <= pb && pa <= pc)
+        return static_cast<uint8_t>(a);
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+#ifdef FLEXIV_AIDK_X86_SIMD
+// Paeth residuals of 16 bytes from i on, returns bytes done
+__attribute__((target("avx2"))) inline size_t
+filter_paeth_avx2(const uint8_t *row, const uint8_t *prior, size_t size,
+                  size_t bpp, uint8_t *out, size_t i)
+{
+    for (; i + 16 <= size; i += 16) {
+        __m256i x = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)));
+        __m256i a = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i - bpp)));
+        __m256i b = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(prior + i)));
+        __m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(prior + i - bpp)));
+        __m256i pa = _mm256_abs_epi16(_mm256_sub_epi16(b, c));
+        __m256i pb = _mm256_abs_epi16(_mm256_sub_epi16(a, c));
+        __m256i pc = _mm256_abs_epi16(
+            _mm256_add_epi16(_mm256_sub_epi16(b, c), _mm256_sub_epi16(a, c)));
+        __m256i predict =
+            _mm256_blendv_epi8(b, c, _mm256_cmpgt_epi16(pb, pc));
+        __m256i use_other = _mm256_or_si256(_mm256_cmpgt_epi16(pa, pb),
+                                            _mm256_cmpgt_epi16(pa, pc));
+        predict = _mm256_blendv_epi8(a, predict, use_other);
+        __m256i residual = _mm256_and_si256(_mm256_sub_epi16(x, predict),
+                                            _mm256_set1_epi16(0xff));
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(out + i),
+            _mm_packus_epi16(_mm256_castsi256_si128(residual),
+                             _mm256_extracti128_si256(residual, 1)));
+    }
+    return i;
+}
+
+// Paeth residuals of 8 bytes, widened to 16-bit lanes
+__attribute__((target("sse4.1"))) inline __m128i
+paeth_residual_8(__m128i x, __m128i a, __m128i b, __m128i c)
+{
+    __m128i pa = _mm_abs_epi16(_mm_sub_epi16(b, c));
+    __m128i pb = _mm_abs_epi16(_mm_sub_epi16(a, c));
+    __m128i pc = _mm_abs_epi16(
+        _mm_add_epi16(_mm_sub_epi16(b, c), _mm_sub_epi16(a, c)));
+    __m128i use_c = _mm_cmpgt_epi16(pb, pc);
+    __m128i predict = _mm_blendv_epi8(b, c, use_c);
+    __m128i use_other =
+        _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    predict = _mm_blendv_epi8(a, predict, use_other);
+    return _mm_and_si128(_mm_sub_epi16(x, predict), _mm_set1_epi16(0xff));
+}
+
+// 8 bytes widened to 16-bit lanes
+__attribute__((target("sse4.1"))) inline __m128i load_8(const uint8_t *p)
+{
+    return _mm_cvtepu8_epi16(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+__attribute__((target("sse4.1"))) inline size_t
+filter_paeth_sse41(const uint8_t *row, const uint8_t *prior, size_t size,
+                   size_t bpp, uint8_t *out, size_t i)
+{
+    for (; i + 16 <= size; i += 16) {
+        __m128i low =
+            paeth_residual_8(load_8(row + i), load_8(row + i - bpp),
+                             load_8(prior + i), load_8(prior + i - bpp));
+        __m128i high = paeth_residual_8(
+            load_8(row + i + 8), load_8(row + i + 8 - bpp),
+            load_8(prior + i + 8), load_8(prior + i + 8 - bpp));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm_packus_epi16(low, high));
+    }
+    return i;
+}
+#endif
+
+/**
+ * @brief PNG Paeth filter of one row. With bpp 2 on 16-bit depth, the left
+ * and upper neighbours predict smooth surfaces well, and invalid zero runs
+ * filter to zero runs which run-length deflate packs tightly.
+ *
+ * @param row converted row.
+ * @param prior converted row above, zeros for the first row.
+ * @param size bytes per row.
+ * @param bpp bytes per pixel.
+ * @param out filtered bytes.
+ */
+inline void filter_paeth(const uint8_t *row, const uint8_t *prior, size_t size,
+                         size_t bpp, uint8_t *out)
+{
+    size_t i = 0;
+    for (; i < bpp && i < size; i++) {
+        out[i] = static_cast<uint8_t>(row[i] - prior[i]);
+    }
+#ifdef FLEXIV_AIDK_X86_SIMD
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            i = filter_paeth_avx2(row, prior, size, bpp, out, i);
+            break;
+        case SIMD_SSE41:
+            i = filter_paeth_sse41(row, prior, size, bpp, out, i);
+            break;
+        case SIMD_NONE:
+            break;
+    }
+#endif
+    for (; i < size; i++) {
+        out[i] = static_cast<uint8_t>(
+            row[i] - paeth_predict(row[i - bpp], prior[i], prior[i - bpp]));
+    }
+}
+
+// Convert one row to PNG sample layout: RGB, big-endian 16-bit gray
+inline void convert_row(const RawImage &image, int y, uint8_t *out)
+{
+    const uint8_t *row = image_row(image, y);
+    switch (image.format) {
+        case RGB8:
+            std::memcpy(out, row, static_cast<size_t>(image.width) * 3);
+            break;
+        case BGR8:
+            for (int x = 0; x < image.width; x++) {
+                out[3 * x] = row[3 * x + 2];
+                out[3 * x + 1] = row[3 * x + 1];
+                out[3 * x + 2] = row[3 * x];
+            }
+            break;
+        case Z16:
+            swap_bytes_16(row, out, static_cast<size_t>(image.width));
+            break;
+        case Z32F:
+            for (int x = 0; x < image.width; x++) {
+                float z;
+                std::memcpy(&z, row + 4 * x, 4);
+                float scaled = z * image.depth_scale;
+                uint16_t value = 0;
+                if (std::isfinite(scaled) && scaled > 0.0f)
+                    value = scaled >= 65535.0f
+                                ? 65535
+                                : static_cast<uint16_t>(scaled + 0.5f);
+                out[2 * x] = static_cast<uint8_t>(value >> 8);
+                out[2 * x + 1] = static_cast<uint8_t>(value);
+            }
+            break;
+    }
+}
+
+// Compressed rows [begin, end) of a PNG, as one IDAT chunk
+struct PngStripe
+{
+    int begin = 0;
+
+    int end = 0;
+
+    // whole IDAT chunk, with length and CRC
+    std::vector<u_char> chunk;
+
+    // adler32 and size of the filtered rows, to combine the zlib checksum
+    uLong adler = 1;
+
+    size_t filtered_size = 0;
+};
+
+/**
+ * @brief Filter and compress the rows of one stripe into raw deflate data,
+ * ended by a sync flush, or by the final block for the last stripe. Stripes
+ * are independent, so they can be compressed in parallel and concatenated.
+ * Color uses the up filter on every row but the first, which is cheap. Depth
+ * uses the Paeth filter on every row, see filter_paeth. Stored rows are not
+ * filtered.
+ */
+inline void encode_png_stripe(const RawImage &image, int level, int strategy,
+                              PngStripe &stripe)
+{
+    size_t row_bytes = encoded_row_bytes(image);
+    size_t rows = static_cast<size_t>(stripe.end - stripe.begin);
+
+    // filtered scanlines, each led by its filter type
+    std::vector<uint8_t> filtered((row_bytes + 1) * rows);
+    std::vector<uint8_t> previous(row_bytes), current(row_bytes);
+    if (stripe.begin > 0)
+        convert_row(image, stripe.begin - 1, previous.data());
+    bool depth = is_depth(image);
+    for (int y = stripe.begin; y < stripe.end; y++) {
+        convert_row(image, y, current.data());
+        uint8_t *out = &filtered[(row_bytes + 1) * (y - stripe.begin)];
+        if (level == Z_NO_COMPRESSION) {
+            // stored as is, filtering would gain nothing
+            out[0] = 0;
+            std::memcpy(out + 1, current.data(), row_bytes);
+        } else if (depth) {
+            out[0] = 4;
+            filter_paeth(current.data(), previous.data(), row_bytes, 2,
+                         out + 1);
+        } else if (y == 0) {
+            out[0] = 0;
+            std::memcpy(out + 1, current.data(), row_bytes);
+        } else {
+            out[0] = 2;
+            for (size_t i = 0; i < row_bytes; i++) {
+                out[i + 1] = static_cast<uint8_t>(current[i] - previous[i]);
+            }
+        }
+        current.swap(previous);
+    }
+    stripe.filtered_size = filtered.size();
+    stripe.adler = adler32(1L, filtered.data(),
+                           static_cast<uInt>(filtered.size()));
+
+    z_stream stream {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+        throw std::runtime_error("encode_image: deflate init failed");
+    size_t bound = deflateBound(&stream, static_cast<uLong>(filtered.size()));
+    stripe.chunk.resize(8 + bound + 16);
+    stream.next_in = filtered.data();
+    stream.avail_in = static_cast<uInt>(filtered.size());
+    stream.next_out = &stripe.chunk[8];
+    stream.avail_out = static_cast<uInt>(bound + 16);
+    bool last = stripe.end == image.height;
+    int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    size_t size = stream.total_out;
+    deflateEnd(&stream);
+    if (ret != (last ? Z_STREAM_END : Z_OK))
+        throw std::runtime_error("encode_image: deflate failed");
+
+    put_u32(&stripe.chunk[0], static_cast<uint32_t>(size));
+    std::memcpy(&stripe.chunk[4], "IDAT", 4);
+    stripe.chunk.resize(8 + size + 4);
+    put_u32(&stripe.chunk[8 + size],
+            crc32(0L, &stripe.chunk[4], static_cast<uInt>(size + 4)));
+}
+
+// Split the rows of an image into stripes
+inline std::vector<PngStripe> split_png(const RawImage &image, size_t count)
+{
+    count = std::max<size_t>(1, std::min<size_t>(count, image.height));
+    std::vector<PngStripe> stripes(count);
+    for (size_t i = 0; i < count; i++) {
+        stripes[i].begin = static_cast<int>(image.height * i / count);
+        stripes[i].end = static_cast<int>(image.height * (i + 1) / count);
+    }
+    return stripes;
+}
+
+/**
+ * @brief Assemble a PNG out of compressed stripes. The zlib header and
+ * checksum go in IDAT chunks of their own, so that stripe chunks need no
+ * change.
+ */
+inline void assemble_png(const RawImage &image, int level,
+                         const std::vector<PngStripe> &stripes,
+                         std::vector<u_char> &png)
+{
+    static const uint8_t signature[8] = {0x89, 'P',  'N',  'G',
+                                         '\r', '\n', 0x1a, '\n'};
+    size_t total = 8 + 25 + 14 + 16 + 12;
+    for (const auto &stripe : stripes) {
+        total += stripe.chunk.size();
+    }
+    png.reserve(total);
+    png.resize(8);
+    std::memcpy(png.data(), signature, 8);
+
+    bool depth = is_depth(image);
+    uint8_t header[13];
+    put_u32(header, static_cast<uint32_t>(image.width));
+    put_u32(header + 4, static_cast<uint32_t>(image.height));
+    header[8] = depth ? 16 : 8; // bit depth
+    header[9] = depth ? 0 : 2;  // gray or RGB
+    header[10] = 0;             // deflate
+    header[11] = 0;             // adaptive filtering
+    header[12] = 0;             // no interlace
+    append_chunk(png, "IHDR", header, sizeof(header));
+
+    // zlib header, with the level hint of the deflate level
+    uint8_t zlib_header[2] = {0x78, 0x01};
+    if (level >= 7)
+        zlib_header[1] = 0xda;
+    else if (level >= 6)
+        zlib_header[1] = 0x9c;
+    else if (level >= 2)
+        zlib_header[1] = 0x5e;
+    append_chunk(png, "IDAT", zlib_header, 2);
+
+    uLong adler = 1;
+    for (const auto &stripe : stripes) {
+        png.insert(png.end(), stripe.chunk.begin(), stripe.chunk.end());
+        adler = adler32_combine(adler, stripe.adler,
+                                static_cast<z_off_t>(stripe.filtered_size));
+    }
+    uint8_t checksum[4];
+    put_u32(checksum, static_cast<uint32_t>(adler));
+    append_chunk(png, "IDAT", checksum, 4);
+
+    append_chunk(png, "IEND", nullptr, 0);
+}
+
+// Deflate level and strategy of a PNG codec
+inline void png_params(const EncodeOptions &options, int &level,
+                       int &strategy)
+{
+    if (options.codec == FAST_LOSSLESS) {
+        level = Z_BEST_SPEED;
+        strategy = Z_RLE;
+    } else if (options.codec == UNCOMPRESSED) {
+        level = Z_NO_COMPRESSION;
+        strategy = Z_DEFAULT_STRATEGY;
+    } else {
+        if (options.level < 0 || options.level > 9)
+            throw std::invalid_argument("encode_image: level out of 0 to 9");
+        level = options.level;
+        strategy = Z_DEFAULT_STRATEGY;
+    }
+}
+
+// Options of the depth image paired with a color image, JPEG being color only
+inline EncodeOptions depth_options(const EncodeOptions &options)
+{
+    EncodeOptions depth = options;
+    if (depth.codec == JPEG)
+        depth.codec = FAST_LOSSLESS;
+    return depth;
+}
+
+#ifdef FLEXIV_AIDK_WITH_JPEG
+struct JpegError
+{
+    jpeg_error_mgr manager;
+
+    std::jmp_buf jump;
+};
+
+inline void jpeg_error_exit(j_common_ptr info)
+{
+    std::longjmp(reinterpret_cast<JpegError *>(info->err)->jump, 1);
+}
+
+/**
+ * @brief Compress a color image into the memory destination buffer and size.
+ * All state libjpeg changes lives in the caller, since locals of a function
+ * calling setjmp are indeterminate after longjmp unless volatile, and
+ * jpeg_mem_dest cannot take volatile pointers.
+ *
+ * @return false on a libjpeg error.
+ */
+inline bool compress_jpeg(const RawImage &image, int quality,
+                          jpeg_compress_struct &info, JpegError &error,
+                          unsigned char **buffer, unsigned long *size)
+{
+    // set up before setjmp, unchanged afterwards
+    std::vector<uint8_t> row(encoded_row_bytes(image));
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpeg_error_exit;
+    if (setjmp(error.jump))
+        return false;
+
+    jpeg_create_compress(&info);
+    jpeg_mem_dest(&info, buffer, size);
+    info.image_width = static_cast<JDIMENSION>(image.width);
+    info.image_height = static_cast<JDIMENSION>(image.height);
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, quality, TRUE);
+    jpeg_start_compress(&info, TRUE);
+    while (info.next_scanline < info.image_height) {
+        convert_row(image, static_cast<int>(info.next_scanline), row.data());
+        JSAMPROW rows[1] = {row.data()};
+        jpeg_write_scanlines(&info, rows, 1);
+    }
+    jpeg_finish_compress(&info);
+    return true;
+}
+
+inline void encode_jpeg(const RawImage &image, int quality,
+                        std::vector<u_char> &jpeg)
+{
+    if (is_depth(image))
+        throw std::invalid_argument("encode_image: JPEG needs a color image");
+    if (quality < 1 || quality > 100)
+        throw std::invalid_argument("encode_image: quality out of 1 to 100");
+
+    unsigned char *buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_compress_struct info {};
+    JpegError error;
+    bool done = compress_jpeg(image, quality, info, error, &buffer, &size);
+    jpeg_destroy_compress(&info);
+    if (!done) {
+        std::free(buffer);
+        throw std::runtime_error("encode_image: JPEG encoding failed");
+    }
+    jpeg.assign(buffer, buffer + size);
+    std::free(buffer);
+}
+#endif
+
+// Encode a JPEG, or throw if built without JPEG support
+inline void encode_jpeg_or_throw(const RawImage &image, int quality,
+                                 std::vector<u_char> &jpeg)
+{
+#ifdef FLEXIV_AIDK_WITH_JPEG
+    encode_jpeg(image, quality, jpeg);
+#else
+    (void)image;
+    (void)quality;
+    (void)jpeg;
+    throw std::invalid_argument("encode_image: built without JPEG support");
+#endif
+}
+
+} /* namespace detail */
+
+inline void encode_image(const RawImage &image, std::vector<u_char> &encoded,
+                         const EncodeOptions &options)
+{
+    detail::check_image(image);
+    if (options.codec == JPEG) {
+        detail::encode_jpeg_or_throw(image, options.quality, encoded);
+        return;
+    }
+    int level = 0, strategy = 0;
+    detail::png_params(options, level, strategy);
+    auto stripes = detail::split_png(image, 1);
+    detail::encode_png_stripe(image, level, strategy, stripes.front());
+    detail::assemble_png(image, level, stripes, encoded);
+}
+
+inline bool is_loopback_host(const std::string &ip)
+{
+    if (ip == "localhost")
+        return true;
+    in_addr v4;
+    if (inet_pton(AF_INET, ip.c_str(), &v4) == 1)
+        return (ntohl(v4.s_addr) >> 24) == 127;
+    in6_addr v6;
+    if (inet_pton(AF_INET6, ip.c_str(), &v6) == 1) {
+        // IPv4-mapped, e.g. ::ffff:127.0.0.1
+        if (IN6_IS_ADDR_V4MAPPED(&v6))
+            return v6.s6_addr[12] == 127;
+        return IN6_IS_ADDR_LOOPBACK(&v6);
+    }
+    return false;
+}
+
+inline EncodeOptions encode_options_for_host(const std::string &ip)
+{
+    EncodeOptions options;
+    if (is_loopback_host(ip))
+        options.codec = UNCOMPRESSED;
+    return options;
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
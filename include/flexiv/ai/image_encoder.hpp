@@ -0,0 +1,351 @@
+/**
+ * @file image_encoder.hpp
+ * @brief declaration of ImageEncoder, multi-threaded encoding of raw images
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "flexiv/ai/image.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// One image to encode by ImageEncoder::encode_all
+struct EncodeTask
+{
+    // raw image, only read during the call
+    const RawImage *image = nullptr;
+
+    // encoded image, replaced
+    std::vector<u_char> *encoded = nullptr;
+
+    EncodeOptions options;
+};
+
+/**
+ * @brief Encoder of raw images over several threads.
+ *
+ * PNG images are cut into horizontal stripes compressed in parallel and
+ * joined into a single valid PNG. A JPEG image is encoded on one thread, but
+ * in parallel with the other image of a pair. The calling thread takes part
+ * in the work, and an encoder can be shared by several calling threads.
+ */
+class ImageEncoder
+{
+public:
+    /**
+     * @brief Constructor of encoder.
+     *
+     * @param num_threads threads encoding, including the calling thread, 0
+     * for one per core.
+     */
+    explicit ImageEncoder(size_t num_threads = 0);
+
+    /**
+     * @brief Destructor of encoder, waits for running encodings.
+     */
+    ~ImageEncoder();
+
+    ImageEncoder(const ImageEncoder &) = delete;
+    ImageEncoder &operator=(const ImageEncoder &) = delete;
+
+    /**
+     * @brief Get number of threads encoding, including the calling thread.
+     *
+     * @return number of threads.
+     */
+    size_t get_num_threads() const noexcept { return workers.size() + 1; }
+
+    /**
+     * @brief Encode a raw image, see encode_image.
+     *
+     * @param image raw image, only read during the call.
+     * @param encoded encoded image, replaced.
+     * @param options codec and its level or quality.
+     * @throw std::invalid_argument if image is empty or malformed, or if the
+     * codec does not suit the image.
+     */
+    void encode(const RawImage &image, std::vector<u_char> &encoded,
+                const EncodeOptions &options = EncodeOptions());
+
+    /**
+     * @brief Encode a color and depth pair at once, see encode_image.
+     *
+     * @param rgb raw color image, only read during the call.
+     * @param depth raw depth image, only read during the call.
+     * @param rgb_encoded encoded color image, replaced.
+     * @param depth_encoded encoded depth image, replaced.
+     * @param rgb_options codec of color image.
+     * @param depth_options codec of depth image.
+     * @throw std::invalid_argument if an image is empty or malformed, or if a
+     * codec does not suit its image.
+     */
+    void encode_pair(const RawImage &rgb, const RawImage &depth,
+                     std::vector<u_char> &rgb_encoded,
+                     std::vector<u_char> &depth_encoded,
+                     const EncodeOptions &rgb_options = EncodeOptions(),
+                     const EncodeOptions &depth_options = EncodeOptions());
+
+    /**
+     * @brief Encode several raw images at once, e.g. the views of several
+     * cameras, threads being shared by image size. See encode_image.
+     *
+     * @param tasks images with their output and codec.
+     * @throw std::invalid_argument if an image is empty or malformed, or if a
+     * codec does not suit its image.
+     */
+    void encode_all(const std::vector<EncodeTask> &tasks);
+
+private:
+    // Encoding tasks of one call, tracked until all are done
+    struct Group
+    {
+        size_t remaining = 0;
+
+        std::exception_ptr error;
+    };
+
+    struct Task
+    {
+        std::function<void()> work;
+
+        std::shared_ptr<Group> group;
+    };
+
+    // Stripes of one image, and how to finish it once they are done
+    struct Job
+    {
+        const RawImage *image = nullptr;
+
+        std::vector<u_char> *encoded = nullptr;
+
+        EncodeOptions options;
+
+        int level = 0;
+
+        int strategy = 0;
+
+        std::vector<detail::PngStripe> stripes;
+    };
+
+    // Prepare tasks of one image, appended to tasks
+    void plan(Job &job, size_t num_stripes,
+              std::vector<std::function<void()>> &tasks);
+
+    // Run tasks on the workers and the calling thread, rethrows the first
+    // error
+    void run_all(std::vector<std::function<void()>> tasks);
+
+    // Run one task and account it to its group
+    void execute(Task &task);
+
+    void run();
+
+    std::mutex mutex;
+
+    // signaled on new tasks and on stop
+    std::condition_variable task_cv;
+
+    // signaled when a group is done
+    std::condition_variable done_cv;
+
+    std::deque<Task> tasks;
+
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+};
+
+inline ImageEncoder::ImageEncoder(size_t num_threads)
+{
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 1; i < num_threads; i++) {
+        workers.emplace_back(&ImageEncoder::run, this);
+    }
+}
+
+inline ImageEncoder::~ImageEncoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_cv.notify_all();
+    for (auto &worker : workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+inline void ImageEncoder::encode(const RawImage &image,
+                                 std::vector<u_char> &encoded,
+                                 const EncodeOptions &options)
+{
+    Job job;
+    job.image = &image;
+    job.encoded = &encoded;
+    job.options = options;
+    std::vector<std::function<void()>> tasks;
+    plan(job, get_num_threads(), tasks);
+    run_all(std::move(tasks));
+    if (options.codec != JPEG)
+        detail::assemble_png(image, job.level, job.stripes, encoded);
+}
+
+inline void ImageEncoder::encode_pair(const RawImage &rgb,
+                                      const RawImage &depth,
+                                      std::vector<u_char> &rgb_encoded,
+                                      std::vector<u_char> &depth_encoded,
+                                      const EncodeOptions &rgb_options,
+                                      const EncodeOptions &depth_options)
+{
+    std::vector<EncodeTask> tasks(2);
+    tasks[0].image = &rgb;
+    tasks[0].encoded = &rgb_encoded;
+    tasks[0].options = rgb_options;
+    tasks[1].image = &depth;
+    tasks[1].encoded = &depth_encoded;
+    tasks[1].options = depth_options;
+    encode_all(tasks);
+}
+
+inline void ImageEncoder::encode_all(const std::vector<EncodeTask> &images)
+{
+    if (images.empty())
+        return;
+    std::vector<Job> jobs(images.size());
+    size_t total_bytes = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+        jobs[i].image = images[i].image;
+        jobs[i].encoded = images[i].encoded;
+        jobs[i].options = images[i].options;
+        detail::check_image(*jobs[i].image);
+        total_bytes += detail::encoded_row_bytes(*jobs[i].image)
+                       * static_cast<size_t>(jobs[i].image->height);
+    }
+
+    // share threads by image size, e.g. 3 to 2 for color and depth
+    size_t threads = get_num_threads();
+    std::vector<std::function<void()>> tasks;
+    for (auto &job : jobs) {
+        size_t bytes = detail::encoded_row_bytes(*job.image)
+                       * static_cast<size_t>(job.image->height);
+        size_t stripes = (threads * bytes + total_bytes / 2) / total_bytes;
+        plan(job, std::max<size_t>(1, stripes), tasks);
+    }
+    run_all(std::move(tasks));
+    for (auto &job : jobs) {
+        if (job.options.codec != JPEG)
+            detail::assemble_png(*job.image, job.level, job.stripes,
+                                 *job.encoded);
+    }
+}
+
+inline void ImageEncoder::plan(Job &job, size_t num_stripes,
+                               std::vector<std::function<void()>> &tasks)
+{
+    const RawImage &image = *job.image;
+    detail::check_image(image);
+    if (job.options.codec == JPEG) {
+        std::vector<u_char> *encoded = job.encoded;
+        int quality = job.options.quality;
+        tasks.push_back([&image, encoded, quality]() {
+            detail::encode_jpeg_or_throw(image, quality, *encoded);
+        });
+        return;
+    }
+
+    detail::png_params(job.options, job.level, job.strategy);
+
+    // stripes below 16 rows cost more in flushes than they gain
+    num_stripes = std::min<size_t>(num_stripes,
+                                   std::max(1, image.height / 16));
+    job.stripes = detail::split_png(image, num_stripes);
+    for (auto &stripe : job.stripes) {
+        detail::PngStripe *target = &stripe;
+        int level = job.level, strategy = job.strategy;
+        tasks.push_back([&image, target, level, strategy]() {
+            detail::encode_png_stripe(image, level, strategy, *target);
+        });
+    }
+}
+
+inline void ImageEncoder::run_all(std::vector<std::function<void()>> work)
+{
+    auto group = std::make_shared<Group>();
+    group->remaining = work.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &function : work) {
+            tasks.push_back({std::move(function), group});
+        }
+    }
+    task_cv.notify_all();
+
+    // help with queued tasks, of any call, until this group is done
+    std::unique_lock<std::mutex> lock(mutex);
+    while (group->remaining > 0) {
+        if (tasks.empty()) {
+            done_cv.wait(lock, [&] {
+                return group->remaining == 0 || !tasks.empty();
+            });
+            continue;
+        }
+        Task task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        execute(task);
+        lock.lock();
+    }
+    if (group->error)
+        std::rethrow_exception(group->error);
+}
+
+inline void ImageEncoder::execute(Task &task)
+{
+    std::exception_ptr error;
+    try {
+        task.work();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    bool done = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error && !task.group->error)
+            task.group->error = error;
+        done = --task.group->remaining == 0;
+    }
+    if (done)
+        done_cv.notify_all();
+}
+
+inline void ImageEncoder::run()
+{
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping)
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        execute(task);
+    }
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
@@ -0,0 +1,220 @@
+/**
+ * @file image_info.hpp
+ * @brief declaration of encoded image header reading and validation
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "flexiv/ai/image.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// Data structure for the header of an encoded image
+struct ImageInfo
+{
+    // PNG or JPEG
+    ImageCodec codec = PNG;
+
+    int width = 0;
+
+    int height = 0;
+
+    // bits per channel sample
+    int bit_depth = 0;
+
+    // channels once decoded, 3 for a palette
+    int channels = 0;
+};
+
+/**
+ * @brief Read the header of an encoded PNG or JPEG image, without decoding
+ * it. Only the PNG IHDR chunk, or the JPEG segments up to the frame header,
+ * are read.
+ *
+ * @param data encoded image.
+ * @param size bytes of encoded image.
+ * @param info header of the image, set on success.
+ * @return true if the image is a PNG or JPEG with a well-formed header.
+ */
+bool read_image_info(const u_char *data, size_t size,
+                     ImageInfo &info) noexcept;
+
+/**
+ * @brief Check encoded detect_with_image input by its headers: color is an
+ * 8-bit PNG or JPEG of 3 or 4 channels, depth a 16-bit single-channel PNG of
+ * the same size, and both match the size in camera_intrinsic, if set.
+ *
+ * @param rgb_input encoded rgb image.
+ * @param depth_input encoded depth image, may be empty.
+ * @param camera_intrinsic camera intrinsic [width, height, ppx, ppy, fx, fy],
+ * size not checked if empty or zero.
+ * @throw std::invalid_argument with the reason if the input is invalid.
+ */
+void validate_images(const std::vector<u_char> &rgb_input,
+                     const std::vector<u_char> &depth_input,
+                     const std::vector<double> &camera_intrinsic = {});
+
+namespace detail {
+
+inline uint32_t get_u32(const u_char *in)
+{
+    return static_cast<uint32_t>(in[0]) << 24
+           | static_cast<uint32_t>(in[1]) << 16
+           | static_cast<uint32_t>(in[2]) << 8 | in[3];
+}
+
+inline uint16_t get_u16(const u_char *in)
+{
+    return static_cast<uint16_t>(in[0] << 8 | in[1]);
+}
+
+inline bool read_png_info(const u_char *data, size_t size,
+                          ImageInfo &info) noexcept
+{
+    static const u_char signature[8] = {0x89, 'P',  'N',  'G',
+                                        '\r', '\n', 0x1a, '\n'};
+    // signature, then IHDR length, type and the fields up to color type
+    if (size < 8 + 8 + 10 || std::memcmp(data, signature, 8) != 0)
+        return false;
+    if (get_u32(data + 8) != 13 || std::memcmp(data + 12, "IHDR", 4) != 0)
+        return false;
+    uint32_t width = get_u32(data + 16), height = get_u32(data + 20);
+    if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX)
+        return false;
+
+    int channels = 0;
+    switch (data[25]) {
+        case 0:
+            channels = 1;
+            break;
+        case 2:
+        case 3:
+            channels = 3;
+            break;
+        case 4:
+            channels = 2;
+            break;
+        case 6:
+            channels = 4;
+            break;
+        default:
+            return false;
+    }
+    info.codec = PNG;
+    info.width = static_cast<int>(width);
+    info.height = static_cast<int>(height);
+    info.bit_depth = data[24];
+    info.channels = channels;
+    return true;
+}
+
+inline bool read_jpeg_info(const u_char *data, size_t size,
+                           ImageInfo &info) noexcept
+{
+    if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+        return false;
+
+    // walk the segments up to the frame header
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xff)
+            return false;
+        u_char marker = data[pos + 1];
+        if (marker == 0xff) {
+            pos++; // fill byte
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+            pos += 2; // no length
+            continue;
+        }
+        if (marker == 0xd9 || marker == 0xda)
+            return false; // end or scan before any frame header
+        size_t length = get_u16(data + pos + 2);
+        if (length < 2 || pos + 2 + length > size)
+            return false;
+
+        // start of frame, but DHT, JPG and DAC share the range
+        bool frame = marker >= 0xc0 && marker <= 0xcf && marker != 0xc4
+                     && marker != 0xc8 && marker != 0xcc;
+        if (frame) {
+            if (length < 8)
+                return false;
+            const u_char *header = data + pos + 4;
+            info.codec = JPEG;
+            info.bit_depth = header[0];
+            info.height = get_u16(header + 1);
+            info.width = get_u16(header + 3);
+            info.channels = header[5];
+            return info.width > 0 && info.height > 0;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+} /* namespace detail */
+
+inline bool read_image_info(const u_char *data, size_t size,
+                            ImageInfo &info) noexcept
+{
+    if (!data)
+        return false;
+    return detail::read_png_info(data, size, info)
+           || detail::read_jpeg_info(data, size, info);
+}
+
+inline void validate_images(const std::vector<u_char> &rgb_input,
+                            const std::vector<u_char> &depth_input,
+                            const std::vector<double> &camera_intrinsic)
+{
+    ImageInfo rgb;
+    if (!read_image_info(rgb_input.data(), rgb_input.size(), rgb))
+        throw std::invalid_argument("rgb_input is not a PNG or JPEG image");
+    if (rgb.bit_depth != 8 || (rgb.channels != 3 && rgb.channels != 4))
+        throw std::invalid_argument(
+            "rgb_input is not 8-bit color, got "
+            + std::to_string(rgb.bit_depth) + "-bit, "
+            + std::to_string(rgb.channels) + " channel(s)");
+
+    if (!depth_input.empty()) {
+        ImageInfo depth;
+        if (!read_image_info(depth_input.data(), depth_input.size(), depth)
+            || depth.codec != PNG)
+            throw std::invalid_argument("depth_input is not a PNG image");
+        if (depth.bit_depth != 16 || depth.channels != 1)
+            throw std::invalid_argument(
+                "depth_input is not 16-bit single-channel, got "
+                + std::to_string(depth.bit_depth) + "-bit, "
+                + std::to_string(depth.channels) + " channel(s)");
+        if (depth.width != rgb.width || depth.height != rgb.height)
+            throw std::invalid_argument(
+                "rgb_input and depth_input size differ, "
+                + std::to_string(rgb.width) + "x" + std::to_string(rgb.height)
+                + " and " + std::to_string(depth.width) + "x"
+                + std::to_string(depth.height));
+    }
+
+    if (camera_intrinsic.size() >= 2 && camera_intrinsic[0] != 0.0
+        && camera_intrinsic[1] != 0.0
+        && (camera_intrinsic[0] != rgb.width
+            || camera_intrinsic[1] != rgb.height))
+        throw std::invalid_argument(
+            "image size " + std::to_string(rgb.width) + "x"
+            + std::to_string(rgb.height)
+            + " differs from camera_intrinsic size");
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
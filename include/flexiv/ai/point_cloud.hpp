@@ -0,0 +1,200 @@
+/**
+ * @file point_cloud.hpp
+ * @brief declaration of organized point cloud input for detect requests
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "flexiv/ai/image.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// Organized point cloud in caller memory, one point per camera pixel
+struct PointCloud
+{
+    // first point, each point starting with float32 x, y, z in meters
+    const void *data = nullptr;
+
+    int width = 0;
+
+    int height = 0;
+
+    // bytes from one point to the next, e.g. 16 for PCL PointXYZRGB
+    size_t point_step = 12;
+
+    // bytes from one row to the next, 0 if rows are packed
+    size_t stride = 0;
+
+    // offset of the B, G, R bytes in a point, -1 if the cloud has no color
+    int rgb_offset = -1;
+
+    // scale from meters to depth units, as RawImage::depth_scale
+    float depth_scale = 1000.0f;
+};
+
+/**
+ * @brief Depth and color images of an organized point cloud, with the camera
+ * intrinsic of the cloud.
+ *
+ * The z of each point is its depth, so the depth image is exact up to Z16
+ * units, with no projection. The intrinsic is fitted to the points by least
+ * squares, so that NoemaEdge deprojects the depth back onto the same points.
+ */
+class CloudFrame
+{
+public:
+    /**
+     * @brief Convert an organized point cloud. Points with a non-finite or
+     * non-positive z are invalid.
+     *
+     * @param cloud organized point cloud, only read during the call.
+     * @throw std::invalid_argument if the cloud is malformed, or has too few
+     * valid points to fit the intrinsic.
+     */
+    explicit CloudFrame(const PointCloud &cloud);
+
+    CloudFrame(const CloudFrame &) = delete;
+    CloudFrame &operator=(const CloudFrame &) = delete;
+
+    /**
+     * @brief Get depth image of the cloud.
+     *
+     * @return raw Z32F image.
+     */
+    const RawImage &get_depth() const noexcept { return depth; }
+
+    /**
+     * @brief Get color image of the cloud, empty if the cloud has no color.
+     *
+     * @return raw BGR8 image.
+     */
+    const RawImage &get_rgb() const noexcept { return rgb; }
+
+    /**
+     * @brief Get camera intrinsic fitted to the cloud.
+     *
+     * @return vector of width, height, ppx, ppy, fx, fy.
+     */
+    const std::vector<double> &get_camera_intrinsic() const noexcept
+    {
+        return camera_intrinsic;
+    }
+
+private:
+    RawImage depth;
+
+    RawImage rgb;
+
+    std::vector<double> camera_intrinsic;
+
+    std::vector<float> depth_buffer;
+
+    std::vector<uint8_t> rgb_buffer;
+};
+
+namespace detail {
+
+// Least squares fit of pixel = scale * ratio + offset
+struct LineFit
+{
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+    void add(double x, double y)
+    {
+        n += 1;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    bool solve(double &scale, double &offset) const
+    {
+        double det = n * sxx - sx * sx;
+        if (n < 2 || std::abs(det) < 1e-12 * n * n)
+            return false;
+        scale = (n * sxy - sx * sy) / det;
+        offset = (sy - scale * sx) / n;
+        return true;
+    }
+};
+
+} /* namespace detail */
+
+inline CloudFrame::CloudFrame(const PointCloud &cloud)
+{
+    if (!cloud.data || cloud.width <= 0 || cloud.height <= 0)
+        throw std::invalid_argument("CloudFrame: empty cloud");
+    if (cloud.point_step < 12)
+        throw std::invalid_argument("CloudFrame: point_step below 12");
+    if (cloud.rgb_offset >= 0
+        && static_cast<size_t>(cloud.rgb_offset) + 3 > cloud.point_step)
+        throw std::invalid_argument("CloudFrame: rgb_offset beyond a point");
+    size_t stride = cloud.stride != 0
+                        ? cloud.stride
+                        : cloud.point_step * static_cast<size_t>(cloud.width);
+    if (stride < cloud.point_step * static_cast<size_t>(cloud.width))
+        throw std::invalid_argument("CloudFrame: stride below row size");
+
+    size_t pixels = static_cast<size_t>(cloud.width) * cloud.height;
+    depth_buffer.resize(pixels);
+    if (cloud.rgb_offset >= 0)
+        rgb_buffer.resize(pixels * 3);
+
+    // u = fx * x / z + ppx, v = fy * y / z + ppy
+    detail::LineFit fit_u, fit_v;
+    for (int v = 0; v < cloud.height; v++) {
+        const uint8_t *row = static_cast<const uint8_t *>(cloud.data)
+                             + stride * static_cast<size_t>(v);
+        for (int u = 0; u < cloud.width; u++) {
+            const uint8_t *point = row + cloud.point_step * u;
+            float xyz[3];
+            std::memcpy(xyz, point, sizeof(xyz));
+            size_t i = static_cast<size_t>(v) * cloud.width + u;
+            bool valid = std::isfinite(xyz[0]) && std::isfinite(xyz[1])
+                         && std::isfinite(xyz[2]) && xyz[2] > 0.0f;
+            depth_buffer[i] = valid ? xyz[2] : 0.0f;
+            if (valid) {
+                fit_u.add(xyz[0] / xyz[2], u);
+                fit_v.add(xyz[1] / xyz[2], v);
+            }
+            if (cloud.rgb_offset >= 0)
+                std::memcpy(&rgb_buffer[3 * i], point + cloud.rgb_offset, 3);
+        }
+    }
+
+    double fx = 0, ppx = 0, fy = 0, ppy = 0;
+    if (!fit_u.solve(fx, ppx) || !fit_v.solve(fy, ppy) || fx <= 0 || fy <= 0)
+        throw std::invalid_argument(
+            "CloudFrame: too few valid points to fit the intrinsic");
+    camera_intrinsic = {static_cast<double>(cloud.width),
+                        static_cast<double>(cloud.height),
+                        ppx,
+                        ppy,
+                        fx,
+                        fy};
+
+    depth.data = depth_buffer.data();
+    depth.width = cloud.width;
+    depth.height = cloud.height;
+    depth.format = Z32F;
+    depth.depth_scale = cloud.depth_scale;
+    if (cloud.rgb_offset >= 0) {
+        rgb.data = rgb_buffer.data();
+        rgb.width = cloud.width;
+        rgb.height = cloud.height;
+        rgb.format = BGR8;
+    }
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
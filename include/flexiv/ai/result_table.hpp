@@ -0,0 +1,449 @@
+/**
+ * @file result_table.hpp
+ * @brief declaration of ResultTable, detection results of all instances in
+ * flat arrays
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flexiv/ai/detection_result.hpp"
+#include "flexiv/ai/views.hpp"
+
+namespace flexiv {
+namespace ai {
+
+/**
+ * @brief Detection results of all instances of an object, one flat array per
+ * field instead of one ObjMetaData per instance.
+ *
+ * Instance i is row i of every field. Fixed-size fields hold one entry per
+ * row, so filtering, sorting and vectorized post-processing run over
+ * contiguous memory. Variable-length fields hold the entries of all rows back
+ * to back, and an offset table of size() + 1 entries gives the range of each
+ * row, e.g. the keypoints of row i are [get_keypoint_offsets()[i],
+ * get_keypoint_offsets()[i + 1]).
+ *
+ * A table keeps its capacity when refilled, so refilling it on every detect
+ * allocates nothing once it has grown to the largest instance count. Filled
+ * straight from a client, no DetectionResult is built at all.
+ * Tables are not thread-safe, use one per thread.
+ */
+class ResultTable
+{
+public:
+    /**
+     * @brief Constructor of an empty table.
+     */
+    ResultTable();
+
+    /**
+     * @brief Fill the table with all instances of an object of a result.
+     *
+     * @param result detection result.
+     * @param obj_name string of object name.
+     * @return true if the object was detected, else the table is empty.
+     */
+    bool assign(const DetectionResult &result, const std::string &obj_name);
+
+    /**
+     * @brief Fill the table with all instances of an object of a result.
+     *
+     * @param result detection result.
+     * @param obj_index index of object, see DetectionResult::find_obj, the
+     * table is empty if out of range.
+     */
+    void assign(const DetectionResult &result, size_t obj_index);
+
+    /**
+     * @brief Fill the table with all instances of an object of the last
+     * detection of a client, parsing the results straight into the table.
+     * Must be called before the client starts the next detection.
+     *
+     * @param client client which just finished a detect request.
+     * @param obj_name string of object name.
+     * @return true if a result of the object was parsed, else the table is
+     * empty.
+     */
+    bool assign(AIDKClient &client, const std::string &obj_name);
+
+    /**
+     * @brief Fill the table with some rows of another table, in the given
+     * order, e.g. to filter or sort it.
+     *
+     * @param other table to copy from, not this table.
+     * @param rows row indexes of other, each less than other.size().
+     * @throw std::invalid_argument if other is this table or a row is out of
+     * range.
+     */
+    void assign(const ResultTable &other, const std::vector<uint32_t> &rows);
+
+    /**
+     * @brief Remove all rows, keeping the capacity. May allocate the offset
+     * tables of a moved-from table.
+     */
+    void clear();
+
+    /**
+     * @brief Get number of rows, one per instance.
+     *
+     * @return number of rows.
+     */
+    size_t size() const noexcept { return is_valid.size(); }
+
+    /**
+     * @brief Check whether the table has no row.
+     *
+     * @return true/false.
+     */
+    bool empty() const noexcept { return is_valid.empty(); }
+
+    /**
+     * @brief Get valid flags, 1 if the robot should process the instance.
+     *
+     * @return array of size() flags.
+     */
+    const std::vector<uint8_t> &get_valid() const noexcept { return is_valid; }
+
+    /**
+     * @brief Get custom double values.
+     *
+     * @return array of size() values.
+     */
+    const std::vector<double> &get_double_values() const noexcept
+    {
+        return double_values;
+    }
+
+    /**
+     * @brief Get custom int values.
+     *
+     * @return array of size() values.
+     */
+    const std::vector<int> &get_int_values() const noexcept
+    {
+        return int_values;
+    }
+
+    /**
+     * @brief Get object poses in the coordinate of the result, all NaN for an
+     * instance without pose.
+     *
+     * @return array of size() poses.
+     */
+    const std::vector<Pose> &get_poses() const noexcept { return poses; }
+
+    /**
+     * @brief Get bboxes [xmin, ymin, xmax, ymax] in image coordinate
+     * [pixel], all 0 for an instance without bbox.
+     *
+     * @return array of size() bboxes.
+     */
+    const std::vector<std::array<int, 4>> &get_bboxes() const noexcept
+    {
+        return bboxes;
+    }
+
+    /**
+     * @brief Get image feature (key point) positions [u, v] of all rows, see
+     * get_keypoint_offsets.
+     *
+     * @return array of points.
+     */
+    const std::vector<std::array<double, 2>> &get_keypoints() const noexcept
+    {
+        return keypoints;
+    }
+
+    /**
+     * @brief Get offsets of the keypoints of each row in get_keypoints.
+     *
+     * @return array of size() + 1 offsets.
+     */
+    const std::vector<uint32_t> &get_keypoint_offsets() const noexcept
+    {
+        return keypoint_offsets;
+    }
+
+    /**
+     * @brief Get image feature 3D positions [x, y, z] in camera coordinate [m]
+     * of all rows, see get_position_offsets.
+     *
+     * @return array of points.
+     */
+    const std::vector<std::array<double, 3>> &get_positions() const noexcept
+    {
+        return positions;
+    }
+
+    /**
+     * @brief Get offsets of the 3D positions of each row in get_positions.
+     *
+     * @return array of size() + 1 offsets.
+     */
+    const std::vector<uint32_t> &get_position_offsets() const noexcept
+    {
+        return position_offsets;
+    }
+
+    /**
+     * @brief Get object type name of a row.
+     *
+     * @param row row index.
+     * @return view of the name in the table, valid until it is refilled,
+     * empty if row is not less than size().
+     */
+    std::string_view get_name(size_t row) const noexcept
+    {
+        // a moved-from table has no offsets at all
+        if (row >= size() || row + 1 >= name_offsets.size())
+            return std::string_view();
+        return std::string_view(names.data() + name_offsets[row],
+                                name_offsets[row + 1] - name_offsets[row]);
+    }
+
+private:
+    // Fill the rows from the parsed results of each key, find(key) giving
+    // the results of all instances or nullptr
+    template <typename Find>
+    void fill(const Find &find);
+
+    // Start the offset tables of an empty table, allocating only on first use
+    void start_rows();
+
+    std::vector<uint8_t> is_valid;
+
+    std::vector<double> double_values;
+
+    std::vector<int> int_values;
+
+    std::vector<Pose> poses;
+
+    std::vector<std::array<int, 4>> bboxes;
+
+    std::vector<std::array<double, 2>> keypoints;
+
+    std::vector<uint32_t> keypoint_offsets;
+
+    std::vector<std::array<double, 3>> positions;
+
+    std::vector<uint32_t> position_offsets;
+
+    // names of all rows back to back
+    std::vector<char> names;
+
+    std::vector<uint32_t> name_offsets;
+
+    // results parsed from a client by key, kept for their capacity
+    std::array<std::vector<Result>, RESULT_KEY_NUM> parsed;
+};
+
+namespace detail {
+
+// Copy the leading values of a result vector into a fixed-size point, padded
+// with 0
+template <size_t N>
+inline std::array<double, N> to_point(const std::vector<double> &values)
+{
+    std::array<double, N> point {};
+    for (size_t j = 0; j < N && j < values.size(); j++) {
+        point[j] = values[j];
+    }
+    return point;
+}
+
+} /* namespace detail */
+
+inline ResultTable::ResultTable()
+{
+    keypoint_offsets.reserve(1);
+    position_offsets.reserve(1);
+    name_offsets.reserve(1);
+    start_rows();
+}
+
+inline bool ResultTable::assign(const DetectionResult &result,
+                                const std::string &obj_name)
+{
+    int obj_index = result.find_obj(obj_name);
+    if (obj_index < 0) {
+        clear();
+        return false;
+    }
+    assign(result, static_cast<size_t>(obj_index));
+    return true;
+}
+
+inline void ResultTable::assign(const DetectionResult &result,
+                                size_t obj_index)
+{
+    fill([&](ResultKey key) { return result.find_result(obj_index, key); });
+}
+
+inline bool ResultTable::assign(AIDKClient &client,
+                                const std::string &obj_name)
+{
+    std::array<bool, RESULT_KEY_NUM> found {};
+    bool any = false;
+    for (size_t k = 0; k < RESULT_KEY_NUM; k++) {
+        found[k] = client.parse_result(
+            obj_name, result_key_name(static_cast<ResultKey>(k)), -1,
+            parsed[k]);
+        any = any || found[k];
+    }
+    fill([&](ResultKey key) -> const std::vector<Result> * {
+        return found[key] ? &parsed[key] : nullptr;
+    });
+    return any;
+}
+
+template <typename Find>
+inline void ResultTable::fill(const Find &find)
+{
+    clear();
+    size_t num = 0;
+    for (size_t k = 0; k < RESULT_KEY_NUM; k++) {
+        const auto *all = find(static_cast<ResultKey>(k));
+        if (all && all->size() > num)
+            num = all->size();
+    }
+
+    // rows default as in ObjMetaData, then each key fills its field
+    constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+    Pose no_pose;
+    no_pose.fill(nan);
+    is_valid.assign(num, 1);
+    double_values.assign(num, 0.0);
+    int_values.assign(num, 0);
+    poses.assign(num, no_pose);
+    bboxes.assign(num, std::array<int, 4> {});
+
+    if (const auto *all = find(KEY_VALID)) {
+        for (size_t i = 0; i < all->size(); i++) {
+            is_valid[i] = (*all)[i].valid ? 1 : 0;
+        }
+    }
+    if (const auto *all = find(KEY_DOUBLE_VALUE)) {
+        for (size_t i = 0; i < all->size(); i++) {
+            double_values[i] = (*all)[i].double_value;
+        }
+    }
+    if (const auto *all = find(KEY_INT_VALUE)) {
+        for (size_t i = 0; i < all->size(); i++) {
+            int_values[i] = (*all)[i].int_value;
+        }
+    }
+    if (const auto *all = find(KEY_OBJ_POSE)) {
+        for (size_t i = 0; i < all->size(); i++) {
+            const auto &vect = (*all)[i].vect;
+            if (!vect.empty() && vect.front().size() == no_pose.size())
+                poses[i] = detail::to_point<7>(vect.front());
+        }
+    }
+    if (const auto *all = find(KEY_BBOX)) {
+        for (size_t i = 0; i < all->size(); i++) {
+            // [xmin, ymin, xmax, ymax], flat or split in two points
+            size_t c = 0;
+            std::array<int, 4> corners {};
+            for (const auto &v : (*all)[i].vect) {
+                for (size_t j = 0; j < v.size() && c < 4; j++) {
+                    corners[c++] = static_cast<int>(v[j]);
+                }
+            }
+            if (c == 4)
+                bboxes[i] = corners;
+        }
+    }
+
+    const auto *all_keypoints = find(KEY_KEYPOINTS);
+    const auto *all_positions = find(KEY_POSITIONS);
+    const auto *all_names = find(KEY_NAME);
+    for (size_t i = 0; i < num; i++) {
+        if (all_keypoints && i < all_keypoints->size()) {
+            for (const auto &v : (*all_keypoints)[i].vect) {
+                keypoints.push_back(detail::to_point<2>(v));
+            }
+        }
+        keypoint_offsets.push_back(static_cast<uint32_t>(keypoints.size()));
+        if (all_positions && i < all_positions->size()) {
+            for (const auto &v : (*all_positions)[i].vect) {
+                positions.push_back(detail::to_point<3>(v));
+            }
+        }
+        position_offsets.push_back(static_cast<uint32_t>(positions.size()));
+        if (all_names && i < all_names->size()) {
+            const auto &name = (*all_names)[i].name;
+            names.insert(names.end(), name.begin(), name.end());
+        }
+        name_offsets.push_back(static_cast<uint32_t>(names.size()));
+    }
+}
+
+inline void ResultTable::assign(const ResultTable &other,
+                                const std::vector<uint32_t> &rows)
+{
+    if (&other == this)
+        throw std::invalid_argument(
+            "ResultTable::assign: cannot select rows of itself");
+    for (uint32_t row : rows) {
+        if (row >= other.size())
+            throw std::invalid_argument(
+                "ResultTable::assign: row " + std::to_string(row)
+                + " out of range " + std::to_string(other.size()));
+    }
+
+    clear();
+    for (uint32_t row : rows) {
+        is_valid.push_back(other.is_valid[row]);
+        double_values.push_back(other.double_values[row]);
+        int_values.push_back(other.int_values[row]);
+        poses.push_back(other.poses[row]);
+        bboxes.push_back(other.bboxes[row]);
+        keypoints.insert(keypoints.end(),
+                         other.keypoints.begin() + other.keypoint_offsets[row],
+                         other.keypoints.begin()
+                             + other.keypoint_offsets[row + 1]);
+        keypoint_offsets.push_back(static_cast<uint32_t>(keypoints.size()));
+        positions.insert(positions.end(),
+                         other.positions.begin() + other.position_offsets[row],
+                         other.positions.begin()
+                             + other.position_offsets[row + 1]);
+        position_offsets.push_back(static_cast<uint32_t>(positions.size()));
+        names.insert(names.end(), other.names.begin() + other.name_offsets[row],
+                     other.names.begin() + other.name_offsets[row + 1]);
+        name_offsets.push_back(static_cast<uint32_t>(names.size()));
+    }
+}
+
+inline void ResultTable::clear()
+{
+    is_valid.clear();
+    double_values.clear();
+    int_values.clear();
+    poses.clear();
+    bboxes.clear();
+    keypoints.clear();
+    positions.clear();
+    names.clear();
+    start_rows();
+}
+
+inline void ResultTable::start_rows()
+{
+    keypoint_offsets.assign(1, 0);
+    position_offsets.assign(1, 0);
+    name_offsets.assign(1, 0);
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
@@ -0,0 +1,305 @@
+/**
+ * @file roi.hpp
+ * @brief declaration of client-side region of interest crop and downscale
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "flexiv/ai/detection_result.hpp"
+#include "flexiv/ai/image.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// Region of interest of a frame, in full-frame pixels
+struct Roi
+{
+    int x = 0;
+
+    int y = 0;
+
+    // 0 up to the right edge
+    int width = 0;
+
+    // 0 up to the bottom edge
+    int height = 0;
+
+    // integer binning factor, 1 to keep the resolution
+    int downscale = 1;
+
+    /**
+     * @brief Check if the region is the whole frame at full resolution.
+     *
+     * @return true/false.
+     */
+    bool is_full_frame() const
+    {
+        return x == 0 && y == 0 && width == 0 && height == 0 && downscale == 1;
+    }
+};
+
+/**
+ * @brief Frame cropped and downscaled to a Roi, with the camera intrinsic to
+ * send along and the mapping of image points back to the full frame.
+ *
+ * A crop alone is a view into the caller images, which must then stay alive
+ * while the frame is used. A downscaled frame owns its pixels.
+ */
+class RoiFrame
+{
+public:
+    /**
+     * @brief Crop and downscale a color and depth pair. Color is averaged
+     * over each bin; depth takes the nearest valid value of each bin, so that
+     * no depth is made up across object edges and invalid zeros are ignored.
+     *
+     * @param roi region of interest, clamped to the frame.
+     * @param rgb raw color image.
+     * @param depth raw depth image of the same size, may be empty.
+     * @param camera_intrinsic camera intrinsic of the full frame, vector of
+     * width, height, ppx, ppy, fx, fy.
+     * @throw std::invalid_argument if the region is empty, sizes mismatch, or
+     * the intrinsic is missing while the frame is changed.
+     */
+    RoiFrame(const Roi &roi, const RawImage &rgb, const RawImage &depth,
+             const std::vector<double> &camera_intrinsic);
+
+    RoiFrame(const RoiFrame &) = delete;
+    RoiFrame &operator=(const RoiFrame &) = delete;
+
+    /**
+     * @brief Get color image of the region.
+     *
+     * @return raw image.
+     */
+    const RawImage &get_rgb() const noexcept { return rgb; }
+
+    /**
+     * @brief Get depth image of the region, empty if no depth was given.
+     *
+     * @return raw image.
+     */
+    const RawImage &get_depth() const noexcept { return depth; }
+
+    /**
+     * @brief Get camera intrinsic of the region.
+     *
+     * @return vector of width, height, ppx, ppy, fx, fy.
+     */
+    const std::vector<double> &get_camera_intrinsic() const noexcept
+    {
+        return camera_intrinsic;
+    }
+
+    /**
+     * @brief Map an image point of the region to the full frame, in place.
+     *
+     * @param u horizontal pixel coordinate.
+     * @param v vertical pixel coordinate.
+     */
+    void map_to_full_frame(double &u, double &v) const
+    {
+        get_mapping()(u, v);
+    }
+
+    /**
+     * @brief Get the mapping of image points to the full frame, valid beyond
+     * the life of the frame.
+     *
+     * @return function mapping an image point [u, v] in place.
+     */
+    std::function<void(double &u, double &v)> get_mapping() const
+    {
+        int x = offset_x, y = offset_y, s = scale;
+        return [x, y, s](double &u, double &v) {
+            // pixel centers: region pixel u covers full pixels [u*s, u*s+s)
+            u = (u + 0.5) * s - 0.5 + x;
+            v = (v + 0.5) * s - 0.5 + y;
+        };
+    }
+
+    /**
+     * @brief Copy of a result of this region with bbox and keypoints mapped
+     * to the full frame.
+     *
+     * @param result result of a detect request on this region.
+     * @return shared snapshot, nullptr if result is nullptr.
+     */
+    DetectionResultPtr map_to_full_frame(const DetectionResultPtr &result) const
+    {
+        return result ? result->map_image_points(get_mapping()) : nullptr;
+    }
+
+private:
+    // Crop of an image, as a view
+    static RawImage crop(const RawImage &image, int x, int y, int width,
+                         int height);
+
+    // Downscale an image by binning, into buffer
+    static RawImage bin(const RawImage &image, int factor,
+                        std::vector<uint8_t> &buffer);
+
+    RawImage rgb;
+
+    RawImage depth;
+
+    std::vector<double> camera_intrinsic;
+
+    int offset_x = 0;
+
+    int offset_y = 0;
+
+    int scale = 1;
+
+    std::vector<uint8_t> rgb_buffer;
+
+    std::vector<uint8_t> depth_buffer;
+};
+
+inline RoiFrame::RoiFrame(const Roi &roi, const RawImage &rgb_image,
+                          const RawImage &depth_image,
+                          const std::vector<double> &intrinsic)
+: camera_intrinsic(intrinsic)
+{
+    detail::check_image(rgb_image);
+    if (depth_image.data) {
+        detail::check_image(depth_image);
+        if (depth_image.width != rgb_image.width
+            || depth_image.height != rgb_image.height)
+            throw std::invalid_argument("RoiFrame: rgb and depth size differ");
+    }
+    if (roi.downscale < 1)
+        throw std::invalid_argument("RoiFrame: downscale below 1");
+
+    // clamp to the frame
+    int x0 = std::max(0, roi.x), y0 = std::max(0, roi.y);
+    int x1 = roi.width > 0 ? std::min(rgb_image.width, roi.x + roi.width)
+                           : rgb_image.width;
+    int y1 = roi.height > 0 ? std::min(rgb_image.height, roi.y + roi.height)
+                            : rgb_image.height;
+    int width = (x1 - x0) / roi.downscale * roi.downscale;
+    int height = (y1 - y0) / roi.downscale * roi.downscale;
+    if (width <= 0 || height <= 0)
+        throw std::invalid_argument("RoiFrame: empty region");
+    offset_x = x0;
+    offset_y = y0;
+    scale = roi.downscale;
+
+    rgb = crop(rgb_image, x0, y0, width, height);
+    if (depth_image.data)
+        depth = crop(depth_image, x0, y0, width, height);
+    if (scale > 1) {
+        rgb = bin(rgb, scale, rgb_buffer);
+        if (depth.data)
+            depth = bin(depth, scale, depth_buffer);
+    }
+
+    bool changed = width != rgb_image.width || height != rgb_image.height
+                   || scale != 1;
+    if (!changed)
+        return;
+    if (camera_intrinsic.size() < 6 || camera_intrinsic[4] == 0.0
+        || camera_intrinsic[5] == 0.0)
+        throw std::invalid_argument(
+            "RoiFrame: camera_intrinsic is needed to crop or downscale");
+    camera_intrinsic[0] = rgb.width;
+    camera_intrinsic[1] = rgb.height;
+    camera_intrinsic[2] = (camera_intrinsic[2] - x0 + 0.5) / scale - 0.5;
+    camera_intrinsic[3] = (camera_intrinsic[3] - y0 + 0.5) / scale - 0.5;
+    camera_intrinsic[4] /= scale;
+    camera_intrinsic[5] /= scale;
+}
+
+inline RawImage RoiFrame::crop(const RawImage &image, int x, int y, int width,
+                               int height)
+{
+    RawImage view = image;
+    view.stride = image.stride != 0
+                      ? image.stride
+                      : static_cast<size_t>(image.width)
+                            * bytes_per_pixel(image.format);
+    view.data = detail::image_row(image, y) + x * bytes_per_pixel(image.format);
+    view.width = width;
+    view.height = height;
+    return view;
+}
+
+inline RawImage RoiFrame::bin(const RawImage &image, int factor,
+                              std::vector<uint8_t> &buffer)
+{
+    RawImage binned = image;
+    binned.width = image.width / factor;
+    binned.height = image.height / factor;
+    binned.stride = 0;
+    size_t pixel = bytes_per_pixel(image.format);
+    buffer.resize(static_cast<size_t>(binned.width) * binned.height * pixel);
+    binned.data = buffer.data();
+
+    for (int by = 0; by < binned.height; by++) {
+        uint8_t *out = &buffer[static_cast<size_t>(by) * binned.width * pixel];
+        for (int bx = 0; bx < binned.width; bx++) {
+            if (image.format == BGR8 || image.format == RGB8) {
+                // box average
+                unsigned sum[3] = {0, 0, 0};
+                for (int dy = 0; dy < factor; dy++) {
+                    const uint8_t *row =
+                        detail::image_row(image, by * factor + dy)
+                        + bx * factor * 3;
+                    for (int dx = 0; dx < factor * 3; dx += 3) {
+                        sum[0] += row[dx];
+                        sum[1] += row[dx + 1];
+                        sum[2] += row[dx + 2];
+                    }
+                }
+                unsigned count = static_cast<unsigned>(factor * factor);
+                for (int c = 0; c < 3; c++) {
+                    out[bx * 3 + c] =
+                        static_cast<uint8_t>((sum[c] + count / 2) / count);
+                }
+            } else if (image.format == Z16) {
+                // nearest valid depth, 0 if none
+                uint16_t nearest = 0;
+                for (int dy = 0; dy < factor; dy++) {
+                    const uint8_t *row =
+                        detail::image_row(image, by * factor + dy)
+                        + bx * factor * 2;
+                    for (int dx = 0; dx < factor; dx++) {
+                        uint16_t z;
+                        std::memcpy(&z, row + dx * 2, 2);
+                        if (z != 0 && (nearest == 0 || z < nearest))
+                            nearest = z;
+                    }
+                }
+                std::memcpy(out + bx * 2, &nearest, 2);
+            } else {
+                float nearest = 0.0f;
+                for (int dy = 0; dy < factor; dy++) {
+                    const uint8_t *row =
+                        detail::image_row(image, by * factor + dy)
+                        + bx * factor * 4;
+                    for (int dx = 0; dx < factor; dx++) {
+                        float z;
+                        std::memcpy(&z, row + dx * 4, 4);
+                        if (std::isfinite(z) && z > 0.0f
+                            && (nearest == 0.0f || z < nearest))
+                            nearest = z;
+                    }
+                }
+                std::memcpy(out + bx * 4, &nearest, 4);
+            }
+        }
+    }
+    return binned;
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
@@ -0,0 +1,719 @@
+/**
+ * @file scene_gate.hpp
+ * @brief declaration of SceneGate, skipping detect requests on an unchanged
+ * scene
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "flexiv/ai/detect_handle.hpp"
+#include "flexiv/ai/image.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// Options of scene change detection
+struct SceneGateOptions
+{
+    // side of the square blocks of pixels averaged into one sample, 1 to
+    // 65536
+    int block_size = 8;
+
+    // change of block luma counted as a change, 0 to 255
+    int color_tolerance = 12;
+
+    // change of block depth counted as a change, in Z16 units (mm by default)
+    int depth_tolerance = 5;
+
+    // ratio of changed blocks, of color or depth, above which the scene has
+    // changed
+    double change_ratio = 0.001;
+};
+
+// Parameters of a detect request besides its images, a previous result is
+// only reused for a request with the same parameters
+struct SceneRequest
+{
+    std::string obj_name;
+
+    std::string camera_id;
+
+    int coordinate_id = 1;
+
+    std::vector<double> camera_pose;
+
+    std::vector<double> camera_intrinsic;
+
+    std::vector<double> tcp_pose;
+
+    std::vector<double> tcp_force;
+
+    std::string custom;
+
+    bool operator==(const SceneRequest &other) const;
+
+    bool operator!=(const SceneRequest &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+/**
+ * @brief Gate ahead of detect requests, skipping a frame whose scene did not
+ * change since the last frame sent, e.g. after a failed grasp that moved
+ * nothing.
+ *
+ * Frames are compared block by block on a downsampled signature: the mean
+ * luma of each block of color and the mean valid depth of each block of
+ * depth. A skipped frame gets the handle of the last request sent, so its
+ * previous result. A frame is always sent if the last request did not
+ * succeed, if the frame size changed, or if the request parameters differ
+ * from those of the last request sent, e.g. another object or TCP pose.
+ *
+ * Thread safety: every member function can be called concurrently, though
+ * a gate is meant for the frames of one camera. send runs without the gate
+ * lock, so concurrent changed frames are all sent, and the last one to return
+ * becomes the reference.
+ *
+ * Example:
+ *     SceneRequest request {obj_name, camera_id, 1, camera_pose,
+ *                           camera_intrinsic, tcp_pose, tcp_force};
+ *     auto handle = gate.detect(rgb, depth, request, [&]() {
+ *         return client.detect_with_image_async(
+ *             request.obj_name, request.camera_id, request.coordinate_id,
+ *             request.camera_pose, request.camera_intrinsic,
+ *             request.tcp_pose, request.tcp_force, rgb, depth,
+ *             request.custom);
+ *     });
+ */
+class SceneGate
+{
+public:
+    /**
+     * @brief Constructor of gate.
+     *
+     * @param options block size, tolerances and change ratio.
+     * @throw std::invalid_argument if an option is out of range.
+     */
+    explicit SceneGate(const SceneGateOptions &options = SceneGateOptions());
+
+    /**
+     * @brief Send a frame if its scene changed, or reuse the last request.
+     *
+     * @param rgb raw color image, only read during the call.
+     * @param depth raw depth image, only read during the call, may be empty.
+     * @param request parameters the request is sent with.
+     * @param send function sending the detect request of this frame with
+     * request.
+     * @return handle of the request sent, or of the last request if skipped.
+     * @throw std::invalid_argument if an image is malformed.
+     */
+    DetectHandle detect(const RawImage &rgb, const RawImage &depth,
+                        const SceneRequest &request,
+                        const std::function<DetectHandle()> &send);
+
+    /**
+     * @brief Forget the last frame sent, so that the next frame is sent.
+     */
+    void reset();
+
+    /**
+     * @brief Get number of frames sent.
+     *
+     * @return number of frames.
+     */
+    uint64_t get_num_sent() const;
+
+    /**
+     * @brief Get number of frames skipped.
+     *
+     * @return number of frames.
+     */
+    uint64_t get_num_skipped() const;
+
+private:
+    // Downsampled frame, one sample per block
+    struct Signature
+    {
+        int width = 0;
+
+        int height = 0;
+
+        std::vector<uint8_t> luma;
+
+        std::vector<uint16_t> depth;
+    };
+
+    // Compute the signature of a frame
+    void sign(const RawImage &rgb, const RawImage &depth,
+              Signature &signature) const;
+
+    // Check if a signature differs from the last frame sent
+    bool changed(const Signature &signature) const;
+
+    SceneGateOptions options;
+
+    mutable std::mutex mutex;
+
+    Signature reference;
+
+    SceneRequest reference_request;
+
+    DetectHandle last;
+
+    uint64_t num_sent = 0;
+
+    uint64_t num_skipped = 0;
+};
+
+namespace detail {
+
+#ifdef FLEXIV_AIDK_X86_SIMD
+// Count samples differing by more than tolerance over whole vectors, returns
+// samples done
+__attribute__((target("avx2"))) inline size_t
+count_changed_8_avx2(const uint8_t *a, const uint8_t *b, size_t size,
+                     uint8_t tolerance, size_t &count)
+{
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(tolerance));
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i va =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i vb =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb),
+                                       _mm256_subs_epu8(vb, va));
+        __m256i within =
+            _mm256_cmpeq_epi8(_mm256_subs_epu8(diff, limit), zero);
+        count += 32
+                 - __builtin_popcount(
+                     static_cast<unsigned>(_mm256_movemask_epi8(within)));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) inline size_t
+count_changed_8_sse41(const uint8_t *a, const uint8_t *b, size_t size,
+                      uint8_t tolerance, size_t &count)
+{
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(tolerance));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        __m128i diff =
+            _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        __m128i within = _mm_cmpeq_epi8(_mm_subs_epu8(diff, limit), zero);
+        count += 16 - __builtin_popcount(_mm_movemask_epi8(within));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) inline size_t
+count_changed_16_avx2(const uint16_t *a, const uint16_t *b, size_t size,
+                      uint16_t tolerance, size_t &count)
+{
+    const __m256i limit = _mm256_set1_epi16(static_cast<short>(tolerance));
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m256i va =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i vb =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        __m256i diff = _mm256_or_si256(_mm256_subs_epu16(va, vb),
+                                       _mm256_subs_epu16(vb, va));
+        __m256i within =
+            _mm256_cmpeq_epi16(_mm256_subs_epu16(diff, limit), zero);
+        // two mask bits per sample
+        count += 16
+                 - __builtin_popcount(
+                       static_cast<unsigned>(_mm256_movemask_epi8(within)))
+                       / 2;
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) inline size_t
+count_changed_16_sse41(const uint16_t *a, const uint16_t *b, size_t size,
+                       uint16_t tolerance, size_t &count)
+{
+    const __m128i limit = _mm_set1_epi16(static_cast<short>(tolerance));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        __m128i diff =
+            _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va));
+        __m128i within = _mm_cmpeq_epi16(_mm_subs_epu16(diff, limit), zero);
+        count += 8 - __builtin_popcount(_mm_movemask_epi8(within)) / 2;
+    }
+    return i;
+}
+
+// Add bytes of a row to 32-bit column sums over whole vectors, returns bytes
+// done
+__attribute__((target("avx2"))) inline size_t
+add_bytes_avx2(const uint8_t *row, size_t size, uint32_t *sums)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        __m256i *low = reinterpret_cast<__m256i *>(sums + i);
+        __m256i *high = reinterpret_cast<__m256i *>(sums + i + 8);
+        _mm256_storeu_si256(low,
+                            _mm256_add_epi32(_mm256_loadu_si256(low),
+                                             _mm256_cvtepu8_epi32(bytes)));
+        _mm256_storeu_si256(
+            high, _mm256_add_epi32(
+                      _mm256_loadu_si256(high),
+                      _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) inline size_t
+add_bytes_sse41(const uint8_t *row, size_t size, uint32_t *sums)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        for (size_t j = 0; j < 16; j += 4) {
+            __m128i *out = reinterpret_cast<__m128i *>(sums + i + j);
+            _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out),
+                                                _mm_cvtepu8_epi32(bytes)));
+            bytes = _mm_srli_si128(bytes, 4);
+        }
+    }
+    return i;
+}
+
+// Add Z16 depth of a row to 32-bit column sums and valid counts over whole
+// vectors, returns pixels done
+__attribute__((target("avx2"))) inline size_t
+add_depth_16_avx2(const uint8_t *row, size_t size, uint32_t *sums,
+                  uint32_t *counts)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i z = _mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + 2 * i)));
+        __m256i *sum = reinterpret_cast<__m256i *>(sums + i);
+        __m256i *count = reinterpret_cast<__m256i *>(counts + i);
+        _mm256_storeu_si256(sum,
+                            _mm256_add_epi32(_mm256_loadu_si256(sum), z));
+        // all ones, so -1, where invalid
+        __m256i invalid = _mm256_cmpeq_epi32(z, zero);
+        _mm256_storeu_si256(
+            count, _mm256_add_epi32(_mm256_loadu_si256(count),
+                                    _mm256_add_epi32(_mm256_set1_epi32(1),
+                                                     invalid)));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) inline size_t
+add_depth_16_sse41(const uint8_t *row, size_t size, uint32_t *sums,
+                   uint32_t *counts)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128i z = _mm_cvtepu16_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i *>(row + 2 * i)));
+        __m128i *sum = reinterpret_cast<__m128i *>(sums + i);
+        __m128i *count = reinterpret_cast<__m128i *>(counts + i);
+        _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), z));
+        __m128i invalid = _mm_cmpeq_epi32(z, zero);
+        _mm_storeu_si128(
+            count,
+            _mm_add_epi32(_mm_loadu_si128(count),
+                          _mm_add_epi32(_mm_set1_epi32(1), invalid)));
+    }
+    return i;
+}
+
+// Add Z32F depth of a row, scaled to Z16 units, to 32-bit column sums and
+// valid counts over whole vectors, returns pixels done
+__attribute__((target("avx2"))) inline size_t
+add_depth_32f_avx2(const uint8_t *row, size_t size, float scale,
+                   uint32_t *sums, uint32_t *counts)
+{
+    const __m256 factor = _mm256_set1_ps(scale);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 infinity =
+        _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 max = _mm256_set1_ps(65535.0f);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256 scaled = _mm256_mul_ps(
+            _mm256_loadu_ps(reinterpret_cast<const float *>(row + 4 * i)),
+            factor);
+        // false for NaN, infinite and non-positive depth
+        __m256i valid = _mm256_castps_si256(
+            _mm256_and_ps(_mm256_cmp_ps(scaled, zero, _CMP_GT_OQ),
+                          _mm256_cmp_ps(scaled, infinity, _CMP_LT_OQ)));
+        __m256i z = _mm256_and_si256(
+            _mm256_cvttps_epi32(
+                _mm256_min_ps(_mm256_add_ps(scaled, half), max)),
+            valid);
+        __m256i *sum = reinterpret_cast<__m256i *>(sums + i);
+        __m256i *count = reinterpret_cast<__m256i *>(counts + i);
+        _mm256_storeu_si256(sum,
+                            _mm256_add_epi32(_mm256_loadu_si256(sum), z));
+        // valid is -1
+        _mm256_storeu_si256(
+            count, _mm256_sub_epi32(_mm256_loadu_si256(count), valid));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) inline size_t
+add_depth_32f_sse41(const uint8_t *row, size_t size, float scale,
+                    uint32_t *sums, uint32_t *counts)
+{
+    const __m128 factor = _mm_set1_ps(scale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 infinity =
+        _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 max = _mm_set1_ps(65535.0f);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128 scaled = _mm_mul_ps(
+            _mm_loadu_ps(reinterpret_cast<const float *>(row + 4 * i)),
+            factor);
+        __m128i valid = _mm_castps_si128(_mm_and_ps(
+            _mm_cmpgt_ps(scaled, zero), _mm_cmplt_ps(scaled, infinity)));
+        __m128i z = _mm_and_si128(
+            _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(scaled, half), max)),
+            valid);
+        __m128i *sum = reinterpret_cast<__m128i *>(sums + i);
+        __m128i *count = reinterpret_cast<__m128i *>(counts + i);
+        _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), z));
+        _mm_storeu_si128(count,
+                         _mm_sub_epi32(_mm_loadu_si128(count), valid));
+    }
+    return i;
+}
+#endif
+
+// Count samples differing by more than tolerance
+inline size_t count_changed_8(const uint8_t *a, const uint8_t *b, size_t size,
+                              uint8_t tolerance)
+{
+    size_t count = 0, i = 0;
+#ifdef FLEXIV_AIDK_X86_SIMD
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            i = count_changed_8_avx2(a, b, size, tolerance, count);
+            break;
+        case SIMD_SSE41:
+            i = count_changed_8_sse41(a, b, size, tolerance, count);
+            break;
+        case SIMD_NONE:
+            break;
+    }
+#endif
+    for (; i < size; i++) {
+        int diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        count += diff > tolerance ? 1 : 0;
+    }
+    return count;
+}
+
+// Count 16-bit samples differing by more than tolerance
+inline size_t count_changed_16(const uint16_t *a, const uint16_t *b,
+                               size_t size, uint16_t tolerance)
+{
+    size_t count = 0, i = 0;
+#ifdef FLEXIV_AIDK_X86_SIMD
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            i = count_changed_16_avx2(a, b, size, tolerance, count);
+            break;
+        case SIMD_SSE41:
+            i = count_changed_16_sse41(a, b, size, tolerance, count);
+            break;
+        case SIMD_NONE:
+            break;
+    }
+#endif
+    for (; i < size; i++) {
+        int diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        count += diff > tolerance ? 1 : 0;
+    }
+    return count;
+}
+
+// Add bytes of a row to 32-bit column sums
+inline void add_bytes(const uint8_t *row, size_t size, uint32_t *sums)
+{
+    size_t i = 0;
+#ifdef FLEXIV_AIDK_X86_SIMD
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            i = add_bytes_avx2(row, size, sums);
+            break;
+        case SIMD_SSE41:
+            i = add_bytes_sse41(row, size, sums);
+            break;
+        case SIMD_NONE:
+            break;
+    }
+#endif
+    for (; i < size; i++) {
+        sums[i] += row[i];
+    }
+}
+
+// Add Z16 depth of a row to 32-bit column sums and valid counts
+inline void add_depth_16(const uint8_t *row, size_t size, uint32_t *sums,
+                         uint32_t *counts)
+{
+    size_t i = 0;
+#ifdef FLEXIV_AIDK_X86_SIMD
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            i = add_depth_16_avx2(row, size, sums, counts);
+            break;
+        case SIMD_SSE41:
+            i = add_depth_16_sse41(row, size, sums, counts);
+            break;
+        case SIMD_NONE:
+            break;
+    }
+#endif
+    for (; i < size; i++) {
+        uint16_t z;
+        std::memcpy(&z, row + 2 * i, 2);
+        sums[i] += z;
+        counts[i] += z != 0 ? 1 : 0;
+    }
+}
+
+// Add Z32F depth of a row, scaled to Z16 units, to 32-bit column sums and
+// valid counts. Invalid depth counts as 0, as when encoded to Z16.
+inline void add_depth_32f(const uint8_t *row, size_t size, float scale,
+                          uint32_t *sums, uint32_t *counts)
+{
+    size_t i = 0;
+#ifdef FLEXIV_AIDK_X86_SIMD
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            i = add_depth_32f_avx2(row, size, scale, sums, counts);
+            break;
+        case SIMD_SSE41:
+            i = add_depth_32f_sse41(row, size, scale, sums, counts);
+            break;
+        case SIMD_NONE:
+            break;
+    }
+#endif
+    for (; i < size; i++) {
+        float z;
+        std::memcpy(&z, row + 4 * i, 4);
+        float scaled = z * scale;
+        if (!std::isfinite(scaled) || scaled <= 0.0f)
+            continue;
+        sums[i] += scaled >= 65535.0f ? 65535
+                                      : static_cast<uint16_t>(scaled + 0.5f);
+        counts[i]++;
+    }
+}
+
+} /* namespace detail */
+
+inline bool SceneRequest::operator==(const SceneRequest &other) const
+{
+    return obj_name == other.obj_name && camera_id == other.camera_id
+           && coordinate_id == other.coordinate_id
+           && camera_pose == other.camera_pose
+           && camera_intrinsic == other.camera_intrinsic
+           && tcp_pose == other.tcp_pose && tcp_force == other.tcp_force
+           && custom == other.custom;
+}
+
+inline SceneGate::SceneGate(const SceneGateOptions &gate_options)
+: options(gate_options)
+{
+    if (options.block_size < 1 || options.block_size > 65536)
+        throw std::invalid_argument("SceneGate: block_size out of 1 to 65536");
+    if (options.color_tolerance < 0 || options.color_tolerance > 255)
+        throw std::invalid_argument(
+            "SceneGate: color_tolerance out of 0 to 255");
+    if (options.depth_tolerance < 0 || options.depth_tolerance > 65535)
+        throw std::invalid_argument(
+            "SceneGate: depth_tolerance out of 0 to 65535");
+}
+
+inline DetectHandle SceneGate::detect(const RawImage &rgb,
+                                      const RawImage &depth,
+                                      const SceneRequest &request,
+                                      const std::function<DetectHandle()> &send)
+{
+    Signature signature;
+    sign(rgb, depth, signature);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto status = last.status();
+        bool reusable =
+            last.valid() && (status == PENDING || status == SUCCEEDED);
+        if (reusable && request == reference_request && !changed(signature)) {
+            num_skipped++;
+            return last;
+        }
+    }
+
+    // send without the lock, so that reset and the counters never wait for it
+    DetectHandle handle = send();
+    std::lock_guard<std::mutex> lock(mutex);
+    last = handle;
+    reference = std::move(signature);
+    reference_request = request;
+    num_sent++;
+    return handle;
+}
+
+inline void SceneGate::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    reference = Signature();
+    reference_request = SceneRequest();
+    last = DetectHandle();
+}
+
+inline uint64_t SceneGate::get_num_sent() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return num_sent;
+}
+
+inline uint64_t SceneGate::get_num_skipped() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return num_skipped;
+}
+
+inline void SceneGate::sign(const RawImage &rgb, const RawImage &depth,
+                            Signature &signature) const
+{
+    detail::check_image(rgb);
+    if (detail::is_depth(rgb))
+        throw std::invalid_argument("SceneGate: rgb must be BGR8 or RGB8");
+    if (depth.data) {
+        detail::check_image(depth);
+        if (!detail::is_depth(depth))
+            throw std::invalid_argument("SceneGate: depth must be Z16 or Z32F");
+    }
+
+    // partial blocks at the right and bottom edges are left out
+    int block = std::min(options.block_size, std::min(rgb.width, rgb.height));
+    signature.width = rgb.width / block;
+    signature.height = rgb.height / block;
+    size_t samples = static_cast<size_t>(signature.width) * signature.height;
+    size_t columns = static_cast<size_t>(signature.width) * block;
+    uint64_t area = static_cast<uint64_t>(block) * block;
+
+    // rows of a block are first added up per column, in 32-bit sums as a
+    // block has at most 65536 rows, then columns per block in 64 bits
+    std::vector<uint32_t> column_sums(3 * columns), column_counts(columns);
+
+    // luma as (c0 + 2 c1 + c2) / 4, the same for BGR and RGB
+    signature.luma.resize(samples);
+    for (int by = 0; by < signature.height; by++) {
+        std::fill(column_sums.begin(), column_sums.end(), 0);
+        for (int dy = 0; dy < block; dy++) {
+            detail::add_bytes(detail::image_row(rgb, by * block + dy),
+                              3 * columns, column_sums.data());
+        }
+        for (int bx = 0; bx < signature.width; bx++) {
+            const uint32_t *column = column_sums.data() + 3 * bx * block;
+            uint64_t sum = 0;
+            for (int dx = 0; dx < 3 * block; dx += 3) {
+                sum += column[dx] + 2 * column[dx + 1] + column[dx + 2];
+            }
+            signature.luma[by * signature.width + bx] =
+                static_cast<uint8_t>((sum + 2 * area) / (4 * area));
+        }
+    }
+
+    // mean of valid depth, 0 if none
+    signature.depth.clear();
+    if (!depth.data)
+        return;
+    if (depth.width != rgb.width || depth.height != rgb.height)
+        throw std::invalid_argument("SceneGate: rgb and depth size differ");
+    signature.depth.resize(samples);
+    bool z16 = depth.format == Z16;
+    for (int by = 0; by < signature.height; by++) {
+        std::fill(column_sums.begin(), column_sums.begin() + columns, 0);
+        std::fill(column_counts.begin(), column_counts.end(), 0);
+        for (int dy = 0; dy < block; dy++) {
+            const uint8_t *row = detail::image_row(depth, by * block + dy);
+            if (z16) {
+                detail::add_depth_16(row, columns, column_sums.data(),
+                                     column_counts.data());
+            } else {
+                detail::add_depth_32f(row, columns, depth.depth_scale,
+                                      column_sums.data(),
+                                      column_counts.data());
+            }
+        }
+        for (int bx = 0; bx < signature.width; bx++) {
+            uint64_t sum = 0, count = 0;
+            for (int dx = bx * block; dx < (bx + 1) * block; dx++) {
+                sum += column_sums[dx];
+                count += column_counts[dx];
+            }
+            signature.depth[by * signature.width + bx] = static_cast<uint16_t>(
+                count != 0 ? (sum + count / 2) / count : 0);
+        }
+    }
+}
+
+inline bool SceneGate::changed(const Signature &signature) const
+{
+    if (signature.width != reference.width
+        || signature.height != reference.height
+        || signature.depth.size() != reference.depth.size())
+        return true;
+
+    auto limit = static_cast<size_t>(options.change_ratio
+                                     * static_cast<double>(
+                                         signature.luma.size()));
+    if (detail::count_changed_8(signature.luma.data(), reference.luma.data(),
+                                signature.luma.size(),
+                                static_cast<uint8_t>(options.color_tolerance))
+        > limit)
+        return true;
+    return detail::count_changed_16(
+               signature.depth.data(), reference.depth.data(),
+               signature.depth.size(),
+               static_cast<uint16_t>(options.depth_tolerance))
+           > limit;
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
@@ -0,0 +1,543 @@
+/**
+ * @file state_monitor.hpp
+ * @brief declaration of StateMonitor, readiness and state tracking of AI Noema
+ * App
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "flexiv/ai/aidk.hpp"
+#include "flexiv/ai/call_options.hpp"
+
+namespace flexiv {
+namespace ai {
+
+// Transition of AI Noema App state
+struct StateChange
+{
+    // state before, status_code is -1 if unknown
+    AIStatus previous;
+
+    AIStatus current;
+
+    // time the new state was seen
+    CallOptions::Clock::time_point timestamp;
+};
+
+/**
+ * @brief Bounded lock-free queue of state changes, filled by StateMonitor and
+ * drained by a single consumer thread. Changes are dropped when full.
+ */
+class StateChangeQueue
+{
+public:
+    /**
+     * @brief Constructor of queue.
+     *
+     * @param capacity max queued changes, rounded up to a power of two.
+     */
+    explicit StateChangeQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    /**
+     * @brief Take the oldest change, without blocking.
+     *
+     * @param change taken change.
+     * @return true if taken, false if empty.
+     */
+    bool try_pop(StateChange &change)
+    {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire))
+            return false;
+        change = std::move(slots[current & mask]);
+        head.store(current + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Get number of changes dropped as the queue was full.
+     *
+     * @return count.
+     */
+    uint64_t get_dropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class StateMonitor;
+
+    // single producer, the monitor thread
+    bool push(const StateChange &change)
+    {
+        size_t current = tail.load(std::memory_order_relaxed);
+        if (current - head.load(std::memory_order_acquire) > mask) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[current & mask] = change;
+        tail.store(current + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::vector<StateChange> slots;
+
+    size_t mask = 0;
+
+    std::atomic<size_t> head {0};
+
+    std::atomic<size_t> tail {0};
+
+    std::atomic<uint64_t> dropped {0};
+};
+
+/**
+ * @brief Tracker of AI Noema App readiness and state over one long-lived
+ * connection.
+ *
+ * NoemaEdge does not push state changes, so a background thread queries the
+ * state on its own connection, one get_current_state per poll, readiness
+ * being the IDLE state as for AIDKClient::is_ready. Callers then wait on a
+ * condition variable instead of polling is_ready themselves. Requests of
+ * other clients are not delayed, as the monitor never shares their
+ * connections.
+ *
+ * The state is only queried while a thread waits for readiness or someone
+ * subscribes, and no request is sent otherwise. While a thread waits for
+ * readiness, or a state subscriber or queue is attached, the state is queried
+ * every poll_interval, so a state lasting less than poll_interval may be
+ * missed. With only readiness subscribers the poll interval doubles while
+ * the state does not change, up to max_poll_interval, and is reset on a
+ * change or a new waiter or subscriber.
+ */
+class StateMonitor
+{
+public:
+    /**
+     * @brief Constructor of monitor, starts monitoring at once.
+     *
+     * @param ip string of AI Noema App ip.
+     * @param request_timeout timeout of each state query(unit:second).
+     * @param poll_interval interval between two state queries after a change,
+     * and while a thread waits or the state is tracked.
+     * @param max_poll_interval interval between two state queries once the
+     * state is steady, with only readiness subscribers.
+     */
+    StateMonitor(const std::string ip, float request_timeout,
+                 std::chrono::milliseconds poll_interval =
+                     std::chrono::milliseconds(50),
+                 std::chrono::milliseconds max_poll_interval =
+                     std::chrono::milliseconds(1000));
+
+    /**
+     * @brief Destructor of monitor, stops monitoring.
+     */
+    ~StateMonitor();
+
+    StateMonitor(const StateMonitor &) = delete;
+    StateMonitor &operator=(const StateMonitor &) = delete;
+
+    /**
+     * @brief Check if AI edge is ready, as of the last query. No request is
+     * sent, and the state is not queried while nobody waits or subscribes.
+     *
+     * @return true/false.
+     */
+    bool is_ready() const;
+
+    /**
+     * @brief Block until AI edge is ready.
+     *
+     * @param deadline time to give up, none by default.
+     * @return true if ready, false on deadline.
+     */
+    bool wait_until_ready(CallOptions::Clock::time_point deadline =
+                              CallOptions::Clock::time_point::max()) const;
+
+    /**
+     * @brief Block until AI edge is ready, at most for a timeout.
+     *
+     * @param timeout time to wait.
+     * @return true if ready, false on timeout.
+     */
+    template <typename Rep, typename Period>
+    bool wait_until_ready_for(
+        const std::chrono::duration<Rep, Period> &timeout) const
+    {
+        return wait_until_ready(
+            CallOptions::Clock::now() +
+            std::chrono::duration_cast<CallOptions::Clock::duration>(timeout));
+    }
+
+    /**
+     * @brief Subscribe to readiness changes. The callback is called on the
+     * monitor thread, with the current readiness once known and then on every
+     * change. It must not subscribe, unsubscribe or destroy the monitor.
+     *
+     * @param callback function called with the new readiness.
+     * @return subscription id.
+     */
+    uint64_t subscribe_ready(std::function<void(bool ready)> callback);
+
+    /**
+     * @brief Subscribe to state changes. The callback is called on the
+     * monitor thread, with the current state once known and then on every
+     * change. It must not subscribe, unsubscribe or destroy the monitor.
+     *
+     * @param callback function called with each change.
+     * @return subscription id.
+     */
+    uint64_t
+    subscribe_state(std::function<void(const StateChange &change)> callback);
+
+    /**
+     * @brief Subscribe to state changes through a queue, e.g. for a real-time
+     * thread which must not run callbacks. The queue gets the current state
+     * once known and then every change, until it is released.
+     *
+     * @param capacity max queued changes.
+     * @return queue of changes.
+     */
+    std::shared_ptr<StateChangeQueue>
+    subscribe_state_queue(size_t capacity = 256);
+
+    /**
+     * @brief Cancel a subscription. Once returned, the callback is no longer
+     * called.
+     *
+     * @param subscription_id id returned by subscribe_ready or
+     * subscribe_state.
+     */
+    void unsubscribe(uint64_t subscription_id);
+
+private:
+    void run();
+
+    // whether the state must be queried, called with mutex held
+    bool tracking_state() const
+    {
+        return !state_subscribers.empty() || !queues.empty();
+    }
+
+    // whether anyone needs a query, called with mutex held
+    bool polling() const
+    {
+        return waiters > 0 || !subscribers.empty() || tracking_state();
+    }
+
+    // Poll at once and from the shortest interval, called with mutex held
+    void wake_up() const
+    {
+        woken = true;
+        cv.notify_all();
+    }
+
+    // ready as for AIDKClient::is_ready, idle and so able to take a request
+    static bool is_ready_state(const AIStatus &status)
+    {
+        return status.status_code == IDLE;
+    }
+
+    static bool same_state(const AIStatus &a, const AIStatus &b)
+    {
+        return a.status_code == b.status_code
+               && a.status_name == b.status_name
+               && a.status_message == b.status_message;
+    }
+
+    std::unique_ptr<AIDKClient> client;
+
+    std::chrono::milliseconds poll_interval;
+
+    std::chrono::milliseconds max_poll_interval;
+
+    mutable std::mutex mutex;
+
+    // signaled on readiness change, on new waiter or subscriber and on stop
+    mutable std::condition_variable cv;
+
+    // threads in wait_until_ready
+    mutable int waiters = 0;
+
+    // set by a new waiter or subscriber
+    mutable bool woken = false;
+
+    // whether ready holds a query of the current polling period
+    bool known = false;
+
+    bool ready = false;
+
+    bool stopping = false;
+
+    uint64_t next_id = 1;
+
+    std::map<uint64_t, std::function<void(bool)>> subscribers;
+
+    // whether state holds a queried state
+    bool state_known = false;
+
+    AIStatus state;
+
+    CallOptions::Clock::time_point state_time;
+
+    std::map<uint64_t, std::function<void(const StateChange &)>>
+        state_subscribers;
+
+    std::vector<std::weak_ptr<StateChangeQueue>> queues;
+
+    // held while callbacks run, so that unsubscribe waits for them
+    std::mutex callback_mutex;
+
+    std::thread monitor_thread;
+};
+
+inline StateMonitor::StateMonitor(const std::string ip, float request_timeout,
+                                  std::chrono::milliseconds poll_interval,
+                                  std::chrono::milliseconds max_poll_interval)
+: client(new AIDKClient(ip, request_timeout))
+, poll_interval(poll_interval)
+, max_poll_interval(std::max(poll_interval, max_poll_interval))
+{
+    monitor_thread = std::thread(&StateMonitor::run, this);
+}
+
+inline StateMonitor::~StateMonitor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (monitor_thread.joinable())
+        monitor_thread.join();
+}
+
+inline bool StateMonitor::is_ready() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return ready;
+}
+
+inline bool
+StateMonitor::wait_until_ready(CallOptions::Clock::time_point deadline) const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto done = [this] { return (known && ready) || stopping; };
+    if (done())
+        return known && ready;
+    waiters++;
+    wake_up();
+    bool result = true;
+    if (deadline == CallOptions::Clock::time_point::max()) {
+        cv.wait(lock, done);
+    } else {
+        result = cv.wait_until(lock, deadline, done);
+    }
+    waiters--;
+    return result && known && ready;
+}
+
+inline uint64_t
+StateMonitor::subscribe_ready(std::function<void(bool ready)> callback)
+{
+    std::lock_guard<std::mutex> callback_lock(callback_mutex);
+    bool current = false;
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = next_id++;
+        subscribers.emplace(id, callback);
+        wake_up();
+        if (!known)
+            return id;
+        current = ready;
+    }
+    // the monitor thread cannot report a change meanwhile, as it needs
+    // callback_mutex to do so
+    callback(current);
+    return id;
+}
+
+inline uint64_t StateMonitor::subscribe_state(
+    std::function<void(const StateChange &change)> callback)
+{
+    std::lock_guard<std::mutex> callback_lock(callback_mutex);
+    StateChange initial;
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = next_id++;
+        state_subscribers.emplace(id, callback);
+        wake_up();
+        if (!state_known)
+            return id;
+        initial.current = state;
+        initial.timestamp = state_time;
+    }
+    callback(initial);
+    return id;
+}
+
+inline std::shared_ptr<StateChangeQueue>
+StateMonitor::subscribe_state_queue(size_t capacity)
+{
+    auto queue = std::make_shared<StateChangeQueue>(capacity);
+    std::lock_guard<std::mutex> callback_lock(callback_mutex);
+    std::lock_guard<std::mutex> lock(mutex);
+    queues.push_back(queue);
+    wake_up();
+    if (state_known) {
+        StateChange initial;
+        initial.current = state;
+        initial.timestamp = state_time;
+        queue->push(initial);
+    }
+    return queue;
+}
+
+inline void StateMonitor::unsubscribe(uint64_t subscription_id)
+{
+    std::lock_guard<std::mutex> callback_lock(callback_mutex);
+    std::lock_guard<std::mutex> lock(mutex);
+    subscribers.erase(subscription_id);
+    state_subscribers.erase(subscription_id);
+}
+
+inline void StateMonitor::run()
+{
+    auto interval = poll_interval;
+    while (true) {
+        bool track = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!polling()) {
+                // results of a later polling period start from unknown
+                known = false;
+                state_known = false;
+                state = AIStatus();
+                cv.wait(lock, [this] { return stopping || polling(); });
+                interval = poll_interval;
+            }
+            if (stopping)
+                return;
+            woken = false;
+            track = tracking_state();
+        }
+
+        // one query gives both readiness and state
+        AIStatus now_state = client->get_current_state();
+        bool now_ready = is_ready_state(now_state);
+        auto now = CallOptions::Clock::now();
+
+        {
+            std::lock_guard<std::mutex> callback_lock(callback_mutex);
+            bool changed = false;
+            std::vector<std::function<void(bool)>> callbacks;
+            bool state_changed = false;
+            StateChange change;
+            std::vector<std::function<void(const StateChange &)>>
+                state_callbacks;
+            std::vector<std::shared_ptr<StateChangeQueue>> state_queues;
+            bool watched = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping)
+                    return;
+                watched = waiters > 0 || tracking_state();
+                if (!known || now_ready != ready) {
+                    changed = true;
+                    known = true;
+                    ready = now_ready;
+                    for (const auto &pair : subscribers) {
+                        callbacks.push_back(pair.second);
+                    }
+                }
+
+                // drop released queues
+                queues.erase(
+                    std::remove_if(queues.begin(), queues.end(),
+                                   [](const std::weak_ptr<StateChangeQueue>
+                                          &queue) { return queue.expired(); }),
+                    queues.end());
+
+                if (!track || !tracking_state()) {
+                    // untracked meanwhile, the next change starts from unknown
+                    state_known = false;
+                    state = AIStatus();
+                } else if (!state_known || !same_state(now_state, state)) {
+                    state_changed = true;
+                    change.previous = state;
+                    change.current = now_state;
+                    change.timestamp = now;
+                    state_known = true;
+                    state = now_state;
+                    state_time = now;
+                    for (const auto &pair : state_subscribers) {
+                        state_callbacks.push_back(pair.second);
+                    }
+                    for (const auto &queue : queues) {
+                        if (auto locked = queue.lock())
+                            state_queues.push_back(std::move(locked));
+                    }
+                }
+            }
+            if (changed)
+                cv.notify_all();
+            for (auto &callback : callbacks) {
+                try {
+                    callback(now_ready);
+                } catch (...) {
+                }
+            }
+            if (state_changed) {
+                for (auto &queue : state_queues) {
+                    queue->push(change);
+                }
+                for (auto &callback : state_callbacks) {
+                    try {
+                        callback(change);
+                    } catch (...) {
+                    }
+                }
+            }
+
+            // back off while steady, only if nobody waits for readiness or
+            // tracks the state
+            interval = changed || state_changed || watched
+                           ? poll_interval
+                           : std::min(2 * interval, max_poll_interval);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (cv.wait_for(lock, interval,
+                        [this] { return stopping || woken || !polling(); })
+            && stopping)
+            return;
+        if (woken)
+            interval = poll_interval;
+    }
+}
+
+} /* namespace ai */
+} /* namespace flexiv */
@@ -0,0 +1,53 @@
+/**
+ * @file views.hpp
+ * @brief declaration of non-owning and fixed-size detect request arguments
+ *
+ * @copyright Copyright (C) 2023 Flexiv Ltd. All Rights Reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace flexiv {
+namespace ai {
+
+// Pose [x, y, z, qw, qx, qy, qz]
+using Pose = std::array<double, 7>;
+
+// Force & wrench [x, y, z, wx, wy, wz]
+using Wrench = std::array<double, 6>;
+
+// Camera intrinsic [width, height, ppx, ppy, fx, fy]
+using Intrinsic = std::array<double, 6>;
+
+// Identity pose, the default camera and tcp pose
+constexpr Pose IDENTITY_POSE = {0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0};
+
+// Non-owning view of encoded image bytes, e.g. in a pinned camera buffer
+struct ByteSpan
+{
+    ByteSpan() = default;
+
+    ByteSpan(const void *data, size_t size)
+    : data(static_cast<const u_char *>(data))
+    , size(size)
+    {}
+
+    const u_char *begin() const noexcept { return data; }
+
+    const u_char *end() const noexcept { return data + size; }
+
+    bool empty() const noexcept { return size == 0; }
+
+    const u_char *data = nullptr;
+
+    size_t size = 0;
+};
+
+} /* namespace ai */
+} /* namespace flexiv */